@@ -43,7 +43,7 @@
 	{ "image-size",		1, 0, OPT_IMAGE_SIZE },	\
 	{ "atags-file",		1, 0, OPT_ATAGS_FILE },
 
-#define KEXEC_ALL_OPT_STR KEXEC_ARCH_OPT_STR "a:r:s:"
+#define KEXEC_ALL_OPT_STR KEXEC_ARCH_OPT_STR "a:r:"
 
 extern unsigned int kexec_arm_image_size;
 
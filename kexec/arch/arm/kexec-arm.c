@@ -76,7 +76,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 struct file_type file_type[] = {
 	/* uImage is probed before zImage because the latter also accepts
 	   uncompressed images. */
-	{"uImage", uImage_arm_probe, uImage_arm_load, zImage_arm_usage},
+	{"uImage", uImage_arm_probe, uImage_arm_load, zImage_arm_usage,
+	 KERNEL_MAGIC_UIMAGE},
 	{"zImage", zImage_arm_probe, zImage_arm_load, zImage_arm_usage},
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
@@ -19,6 +19,7 @@
 #include "../../kexec-syscall.h"
 #include "kexec-arm.h"
 #include "../../fs2dt.h"
+#include "../../dtb_edit.h"
 #include "crashdump-arm.h"
 
 #define BOOT_PARAMS_SIZE 1536
@@ -226,67 +227,6 @@ int atag_arm_load(struct kexec_info *info, unsigned long base,
 	return 0;
 }
 
-static int setup_dtb_prop(char **bufp, off_t *sizep, const char *node_name,
-		const char *prop_name, const void *val, int len)
-{
-	char *dtb_buf;
-	off_t dtb_size;
-	int off;
-	int prop_len = 0;
-	const struct fdt_property *prop;
-
-	if ((bufp == NULL) || (sizep == NULL) || (*bufp == NULL))
-		die("Internal error\n");
-
-	dtb_buf = *bufp;
-	dtb_size = *sizep;
-
-	/* check if the subnode has already exist */
-	off = fdt_path_offset(dtb_buf, node_name);
-	if (off == -FDT_ERR_NOTFOUND) {
-		dtb_size += fdt_node_len(node_name);
-		fdt_set_totalsize(dtb_buf, dtb_size);
-		dtb_buf = xrealloc(dtb_buf, dtb_size);
-		if (dtb_buf == NULL)
-			die("xrealloc failed\n");
-		off = fdt_add_subnode(dtb_buf, off, node_name);
-	}
-
-	if (off < 0) {
-		fprintf(stderr, "FDT: Error adding %s node.\n", node_name);
-		return -1;
-	}
-
-	prop = fdt_get_property(dtb_buf, off, prop_name, &prop_len);
-	if ((prop == NULL) && (prop_len != -FDT_ERR_NOTFOUND)) {
-		die("FDT: fdt_get_property");
-	} else if (prop == NULL) {
-		/* prop_len == -FDT_ERR_NOTFOUND */
-		/* prop doesn't exist */
-		dtb_size += fdt_prop_len(prop_name, len);
-	} else {
-		if (prop_len < len)
-			dtb_size += len - prop_len;
-	}
-
-	if (fdt_totalsize(dtb_buf) < dtb_size) {
-		fdt_set_totalsize(dtb_buf, dtb_size);
-		dtb_buf = xrealloc(dtb_buf, dtb_size);
-		if (dtb_buf == NULL)
-			die("xrealloc failed\n");
-	}
-
-	if (fdt_setprop(dtb_buf, off, prop_name,
-				val, len) != 0) {
-		fprintf(stderr, "FDT: Error setting %s/%s property.\n",
-				node_name, prop_name);
-		return -1;
-	}
-	*bufp = dtb_buf;
-	*sizep = dtb_size;
-	return 0;
-}
-
 int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 	struct kexec_info *info)
 {
@@ -302,6 +242,8 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 	int use_atags;
 	char *dtb_buf;
 	off_t dtb_length;
+	struct dtb_edit dtb;
+	int room;
 	char *dtb_file;
 	off_t dtb_offset;
 	char *end;
@@ -358,6 +300,7 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 
 	if (use_atags && dtb_file) {
 		fprintf(stderr, "You can only use ATAGs if you don't specify a "
@@ -371,7 +314,7 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 			command_line_len = COMMAND_LINE_SIZE;
 	}
 	if (ramdisk) {
-		ramdisk_buf = slurp_file(ramdisk, &initrd_size);
+		ramdisk_buf = slurp_initrd(ramdisk, &initrd_size);
 	}
 
 	/*
@@ -450,17 +393,6 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 				fprintf(stderr, "Invalid FDT buffer.\n");
 				return -1;
 			}
-
-			if (command_line) {
-				/*
-				 *  Error should have been reported so
-				 *  directly return -1
-				 */
-				if (setup_dtb_prop(&dtb_buf, &dtb_length, "/chosen",
-						"bootargs", command_line,
-						strlen(command_line) + 1))
-					return -1;
-			}
 		} else {
 			/*
 			 * Extract the DTB from /proc/device-tree.
@@ -468,10 +400,27 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 			create_flatten_tree(&dtb_buf, &dtb_length, command_line);
 		}
 
-		if (base + atag_offset + dtb_length > base + offset) {
-			fprintf(stderr, "DTB too large!\n");
+		/*
+		 * Make room for everything that is set below at once,
+		 * then pack the result.  fs2dt has already put the
+		 * command line in a tree it built.
+		 */
+		room = fdt_node_len("chosen");
+		if (dtb_file && command_line)
+			room += fdt_prop_len("bootargs",
+					     strlen(command_line) + 1);
+		if (ramdisk)
+			room += fdt_prop_len("linux,initrd-start",
+					     sizeof(unsigned long)) +
+				fdt_prop_len("linux,initrd-end",
+					     sizeof(unsigned long));
+		dtb_edit_open(&dtb, dtb_buf, room);
+
+		/* Errors have been reported, directly return -1 */
+		if (dtb_file && command_line &&
+		    dtb_edit_setprop(&dtb, "/chosen", "bootargs",
+				     command_line, strlen(command_line) + 1))
 			return -1;
-		}
 
 		if (ramdisk) {
 			add_segment(info, ramdisk_buf, initrd_size,
@@ -481,16 +430,23 @@ int zImage_arm_load(int argc, char **argv, const char *buf, off_t len,
 			start = cpu_to_be32((unsigned long)(initrd_base));
 			end = cpu_to_be32((unsigned long)(initrd_base + initrd_size));
 
-			if (setup_dtb_prop(&dtb_buf, &dtb_length, "/chosen",
+			if (dtb_edit_setprop(&dtb, "/chosen",
 					"linux,initrd-start", &start,
 					sizeof(start)))
 				return -1;
-			if (setup_dtb_prop(&dtb_buf, &dtb_length, "/chosen",
+			if (dtb_edit_setprop(&dtb, "/chosen",
 					"linux,initrd-end", &end,
 					sizeof(end)))
 				return -1;
 		}
 
+		dtb_buf = dtb_edit_close(&dtb, &dtb_length);
+
+		if (base + atag_offset + dtb_length > base + offset) {
+			fprintf(stderr, "DTB too large!\n");
+			return -1;
+		}
+
 		/* Stick the dtb at the end of the initrd and page
 		 * align it.
 		 */
@@ -44,7 +44,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 }
 
 struct file_type file_type[] = {
-	{"elf-cris", elf_cris_probe, elf_cris_load, elf_cris_usage},
+	{"elf-cris", elf_cris_probe, elf_cris_load, elf_cris_usage,
+	 KERNEL_MAGIC_ELF},
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
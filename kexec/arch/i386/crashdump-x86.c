@@ -39,6 +39,7 @@
 #include "../../kexec-syscall.h"
 #include "../../firmware_memmap.h"
 #include "../../crashdump.h"
+#include "../../kallsyms.h"
 #include "kexec-x86.h"
 #include "crashdump-x86.h"
 
@@ -103,31 +104,17 @@ static int get_kernel_paddr(struct kexec_info *UNUSED(info),
 /* Retrieve kernel _stext symbol virtual address from /proc/kallsyms */
 static unsigned long long get_kernel_stext_sym(void)
 {
-	const char *kallsyms = "/proc/kallsyms";
 	const char *stext = "_stext";
-	char sym[128];
-	char line[128];
-	FILE *fp;
 	unsigned long long vaddr;
-	char type;
 
-	fp = fopen(kallsyms, "r");
-	if (!fp) {
-		fprintf(stderr, "Cannot open %s\n", kallsyms);
+	vaddr = kallsyms_lookup_name(stext);
+	if (!vaddr) {
+		fprintf(stderr, "Cannot get kernel %s symbol address\n", stext);
 		return 0;
 	}
 
-	while(fgets(line, sizeof(line), fp) != NULL) {
-		if (sscanf(line, "%Lx %c %s", &vaddr, &type, sym) != 3)
-			continue;
-		if (strcmp(sym, stext) == 0) {
-			dbgprintf("kernel symbol %s vaddr = %16llx\n", stext, vaddr);
-			return vaddr;
-		}
-	}
-
-	fprintf(stderr, "Cannot get kernel %s symbol address\n", stext);
-	return 0;
+	dbgprintf("kernel symbol %s vaddr = %16llx\n", stext, vaddr);
+	return vaddr;
 }
 
 /* Retrieve info regarding virtual address kernel has been compiled for and
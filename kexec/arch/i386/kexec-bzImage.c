@@ -428,6 +428,7 @@ int bzImage_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 	command_line = concat_cmdline(tmp_cmdline, append);
 	if (tmp_cmdline) {
 		free(tmp_cmdline);
@@ -441,7 +442,7 @@ int bzImage_load(int argc, char **argv, const char *buf, off_t len,
 	}
 	ramdisk_buf = 0;
 	if (ramdisk) {
-		ramdisk_buf = slurp_file(ramdisk, &ramdisk_length);
+		ramdisk_buf = slurp_initrd(ramdisk, &ramdisk_length);
 	}
 	result = do_bzImage_load(info,
 		buf, len,
@@ -157,6 +157,7 @@ int elf_x86_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 	command_line = concat_cmdline(tmp_cmdline, append);
 	if (tmp_cmdline) {
 		free(tmp_cmdline);
@@ -255,7 +256,7 @@ int elf_x86_load(int argc, char **argv, const char *buf, off_t len,
 		ramdisk_buf = NULL;
 		ramdisk_length = 0;
 		if (ramdisk) {
-			ramdisk_buf = slurp_file(ramdisk, &ramdisk_length);
+			ramdisk_buf = slurp_initrd(ramdisk, &ramdisk_length);
 		}
 
 		/* If panic kernel is being loaded, additional segments need
@@ -134,6 +134,105 @@ void multiboot_x86_usage(void)
 	printf("                                 (can be used multiple times).\n");
 }
 
+struct mb_module {
+	const char *cmdline;	/* "MOD arg1 arg2..." from --module */
+	int fd;			/* read straight into place, or -1 */
+	char *buf;		/* else the slurped contents */
+	off_t size;
+	unsigned long offset;	/* in the modules segment */
+};
+
+/*
+ * Open a module for reading in place.  That is only possible for an
+ * uncompressed regular file, where the size is known up front; anything
+ * else is slurped (and decompressed) now.
+ */
+static void open_module(struct mb_module *mod, const char *filename)
+{
+	unsigned char magic[6];
+	struct stat st;
+	ssize_t len;
+
+	mod->fd = open(filename, O_RDONLY);
+	if (mod->fd >= 0 && fstat(mod->fd, &st) == 0 &&
+	    S_ISREG(st.st_mode)) {
+		len = pread(mod->fd, magic, sizeof(magic), 0);
+		if (len >= 0 && compress_magic(magic, len) == COMPRESS_NONE) {
+			mod->buf = NULL;
+			mod->size = st.st_size;
+			/* Start reading it in while the others are opened */
+			posix_fadvise(mod->fd, 0, 0, POSIX_FADV_WILLNEED);
+			return;
+		}
+	}
+	if (mod->fd >= 0)
+		close(mod->fd);
+	mod->fd = -1;
+	mod->buf = slurp_decompress_file(filename, &mod->size);
+}
+
+/*
+ * Lay the modules out page aligned in a single buffer, so they load as
+ * one segment, and fill in their sizes and offsets.  Plain files are
+ * read straight into place once all of them have been opened, by which
+ * time the readahead started by open_module() is well under way for
+ * every module at once.
+ */
+static char *read_modules(struct mb_module *mods, int modules,
+			  unsigned long *r_size)
+{
+	unsigned long page_size = getpagesize(), offset, end;
+	char *filename, *cp, *buf;
+	off_t done;
+	ssize_t result;
+	int m;
+
+	offset = 0;
+	for (m = 0; m < modules; m++) {
+		/* Split module filename from command line */
+		filename = xmalloc(strlen(mods[m].cmdline) + 1);
+		strcpy(filename, mods[m].cmdline);
+		if ((cp = strchr(filename, ' ')) != NULL)
+			*cp = '\0';
+		open_module(&mods[m], filename);
+		free(filename);
+
+		mods[m].offset = offset;
+		offset = _ALIGN(offset + mods[m].size, page_size);
+	}
+
+	buf = xmalloc(offset);
+	for (m = 0; m < modules; m++) {
+		if (mods[m].fd < 0) {
+			memcpy(buf + mods[m].offset, mods[m].buf, mods[m].size);
+			free(mods[m].buf);
+		} else {
+			for (done = 0; done < mods[m].size; done += result) {
+				result = pread(mods[m].fd,
+					       buf + mods[m].offset + done,
+					       mods[m].size - done, done);
+				if (result < 0 && errno == EINTR) {
+					result = 0;
+					continue;
+				}
+				if (result <= 0)
+					die("Cannot read module %s: %s\n",
+					    mods[m].cmdline,
+					    result ? strerror(errno) :
+					    "file shrank");
+			}
+			close(mods[m].fd);
+		}
+		/* Zero the padding up to the next module */
+		end = m + 1 < modules ? mods[m + 1].offset : offset;
+		memset(buf + mods[m].offset + mods[m].size, 0,
+		       end - mods[m].offset - mods[m].size);
+	}
+
+	*r_size = offset;
+	return buf;
+}
+
 int multiboot_x86_load(int argc, char **argv, const char *buf, off_t len,
 	struct kexec_info *info)
 /* Marshal up a multiboot-style kernel */
@@ -148,7 +247,7 @@ int multiboot_x86_load(int argc, char **argv, const char *buf, off_t len,
 	struct entry32_regs regs;
 	size_t mbi_bytes, mbi_offset;
 	char *command_line = NULL, *tmp_cmdline = NULL;
-	char *imagename, *cp, *append = NULL;;
+	char *imagename, *append = NULL;;
 	struct memory_range *range;
 	int ranges;
 	struct AddrRangeDesc *mmap;
@@ -301,8 +400,10 @@ int multiboot_x86_load(int argc, char **argv, const char *buf, off_t len,
 
 	/* Load modules */
 	if (modules) {
-		char *mod_filename, *mod_command_line, *mod_clp, *buf;
-		off_t mod_size;
+		struct mb_module *mods;
+		char *mod_clp, *mods_buf;
+		unsigned long mods_size, mods_base;
+		int m;
 
 		/* We'll relocate this to an absolute address later */
 		mbi->mods_addr = mbi_bytes;
@@ -322,34 +423,28 @@ int multiboot_x86_load(int argc, char **argv, const char *buf, off_t len,
 		mod_clp = ((void *)modp) + (sizeof(*modp) * modules);
 		
 		/* Go back and parse the module command lines */
+		mods = xmalloc(modules * sizeof(*mods));
+		m = 0;
 		optind = opterr = 1;
 		while((opt = getopt_long(argc, argv, 
 					 short_options, options, 0)) != -1)
 		{
 			if (opt != OPT_MOD) continue;
+			mods[m++].cmdline = optarg;
+		}
 
-			/* Split module filename from command line */
-			mod_command_line = mod_filename = optarg;
-			if ((cp = strchr(mod_filename, ' ')) != NULL) {
-				/* See as I discard the 'const' modifier */
-				*cp = '\0';
-			}
-
-			/* Load the module */
-			buf = slurp_decompress_file(mod_filename, &mod_size);
-			
-			if (cp != NULL) *cp = ' ';
-
-			/* Pick the next aligned spot to load it in */
-			freespace = add_buffer(info,
-				buf, mod_size, mod_size,
-				getpagesize(), 0, 0xffffffffUL, 1);
+		/* Read them all into one buffer, loaded as one segment */
+		mods_buf = read_modules(mods, modules, &mods_size);
+		mods_base = add_buffer(info,
+			mods_buf, mods_size, mods_size,
+			getpagesize(), 0, 0xffffffffUL, 1);
 
+		for (m = 0; m < modules; m++) {
 			/* Add the module command line */
-			sprintf(mod_clp, "%s", mod_command_line);
+			sprintf(mod_clp, "%s", mods[m].cmdline);
 
-			modp->mod_start = freespace;
-			modp->mod_end   = freespace + mod_size;
+			modp->mod_start = mods_base + mods[m].offset;
+			modp->mod_end   = modp->mod_start + mods[m].size;
 			modp->cmdline   = (void *)mod_clp - (void *)mbi;
 			modp->pad       = 0;
 
@@ -358,7 +453,7 @@ int multiboot_x86_load(int argc, char **argv, const char *buf, off_t len,
 			mod_clp += strlen(mod_clp) + 1;
 			modp++;
 		}
-		
+		free(mods);
 	}
 
 	/* Find a place for the MBI to live */
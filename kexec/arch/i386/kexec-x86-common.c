@@ -36,6 +36,7 @@
 #include "../../kexec.h"
 #include "../../kexec-syscall.h"
 #include "../../firmware_memmap.h"
+#include "../../fw_cache.h"
 #include "../../crashdump.h"
 #include "kexec-x86.h"
 
@@ -125,6 +126,17 @@ static int get_memory_ranges_sysfs(struct memory_range **range, int *ranges)
 {
 	int ret;
 	size_t range_number = MAX_MEMORY_RANGES;
+	const void *cached;
+	size_t size;
+
+	cached = fw_cache_get("x86-memmap", &size);
+	if (cached && size <= sizeof(memory_range) &&
+	    size % sizeof(memory_range[0]) == 0) {
+		memcpy(memory_range, cached, size);
+		*range = memory_range;
+		*ranges = size / sizeof(memory_range[0]);
+		return 0;
+	}
 
 	ret = get_firmware_memmap_ranges(memory_range, &range_number);
 	if (ret != 0) {
@@ -132,6 +144,8 @@ static int get_memory_ranges_sysfs(struct memory_range **range, int *ranges)
 			"Falling back to /proc/iomem.\n");
 		return get_memory_ranges_proc_iomem(range, ranges);
 	}
+	fw_cache_put("x86-memmap", memory_range,
+		     range_number * sizeof(memory_range[0]));
 
 	*range = memory_range;
 	*ranges = range_number;
@@ -35,9 +35,11 @@
 
 struct file_type file_type[] = {
 	{ "multiboot-x86", multiboot_x86_probe, multiboot_x86_load,
-	  multiboot_x86_usage },
-	{ "elf-x86", elf_x86_probe, elf_x86_load, elf_x86_usage },
-	{ "bzImage", bzImage_probe, bzImage_load, bzImage_usage },
+	  multiboot_x86_usage, KERNEL_MAGIC_ELF | KERNEL_MAGIC_MULTIBOOT },
+	{ "elf-x86", elf_x86_probe, elf_x86_load, elf_x86_usage,
+	  KERNEL_MAGIC_ELF },
+	{ "bzImage", bzImage_probe, bzImage_load, bzImage_usage,
+	  KERNEL_MAGIC_BZIMAGE },
 	{ "beoboot-x86", beoboot_probe, beoboot_load, beoboot_usage },
 	{ "nbi-x86", nbi_probe, nbi_load, nbi_usage },
 };
@@ -32,6 +32,7 @@
 #include <mntent.h>
 #include <x86/x86-linux.h>
 #include "../../kexec.h"
+#include "../../fw_cache.h"
 #include "kexec-x86.h"
 #include "x86-linux-setup.h"
 #include "../../kexec/kexec-syscall.h"
@@ -184,49 +185,58 @@ int setup_linux_vesafb(struct x86_linux_param_header *real_mode)
 #define EDD_EXT_64BIT_EXTENSIONS            (1 << 3)
 
 /*
- * Scans one line from a given filename. Returns on success the number of
- * items written (same like scanf()).
+ * Read the sysfs attribute "name" below the directory dfd into buf,
+ * which is always nul terminated.  Returns the number of bytes read,
+ * or -errno.
  */
-static int file_scanf(const char *dir, const char *file, const char *scanf_line, ...)
+static ssize_t sysfs_read_attr(int dfd, const char *name, void *buf,
+			       size_t size)
 {
-	va_list argptr;
-	FILE *fp;
-	int retno;
-	char filename[PATH_MAX];
+	ssize_t len;
+	int fd, err;
 
-	snprintf(filename, PATH_MAX, "%s/%s", dir, file);
-	filename[PATH_MAX-1] = 0;
-
-	fp = fopen(filename, "r");
-	if (!fp) {
+	fd = openat(dfd, name, O_RDONLY);
+	if (fd < 0)
 		return -errno;
-	}
-
-	va_start(argptr, scanf_line);
-	retno = vfscanf(fp, scanf_line, argptr);
-	va_end(argptr);
+	len = pread(fd, buf, size - 1, 0);
+	err = errno;
+	close(fd);
+	if (len < 0)
+		return -err;
+	((char *)buf)[len] = '\0';
+	return len;
+}
 
-	fclose(fp);
+/*
+ * Read a sysfs attribute holding a single number.  base is passed to
+ * strtoull(), so base 16 accepts the usual 0x prefix.
+ */
+static int sysfs_read_ull(int dfd, const char *name, int base,
+			  unsigned long long *val)
+{
+	char buf[64], *end;
 
-	return retno;
+	if (sysfs_read_attr(dfd, name, buf, sizeof(buf)) <= 0)
+		return -1;
+	errno = 0;
+	*val = strtoull(buf, &end, base);
+	if (end == buf || errno)
+		return -1;
+	return 0;
 }
 
-static int parse_edd_extensions(const char *dir, struct edd_info *edd_info)
+static int parse_edd_extensions(int dfd, struct edd_info *edd_info)
 {
-	char filename[PATH_MAX];
-	char line[1024];
+	char buf[1024], *line, *eol;
 	uint16_t flags = 0;
-	FILE *fp;
+	ssize_t len;
 
-	snprintf(filename, PATH_MAX, "%s/%s", dir, "extensions");
-	filename[PATH_MAX-1] = 0;
-
-	fp = fopen(filename, "r");
-	if (!fp) {
-		return -errno;
-	}
+	len = sysfs_read_attr(dfd, "extensions", buf, sizeof(buf));
+	if (len < 0)
+		return len;
 
-	while (fgets(line, 1024, fp)) {
+	for (line = buf; *line; line = eol + 1) {
+		eol = strchrnul(line, '\n');
 		/*
 		 * strings are in kernel source, function edd_show_extensions()
 		 * drivers/firmware/edd.c
@@ -239,34 +249,31 @@ static int parse_edd_extensions(const char *dir, struct edd_info *edd_info)
 			flags |= EDD_EXT_ENHANCED_DISK_DRIVE_SUPPORT;
 		else if (strstr(line, "64-bit extensions") == line)
 			flags |= EDD_EXT_64BIT_EXTENSIONS;
+		if (!*eol)
+			break;
 	}
 
-	fclose(fp);
-
 	edd_info->interface_support = flags;
 
 	return 0;
 }
 
-static int read_edd_raw_data(const char *dir, struct edd_info *edd_info)
+static int read_edd_raw_data(int dfd, struct edd_info *edd_info)
 {
-	char filename[PATH_MAX];
-	FILE *fp;
-	size_t read_chars;
+	ssize_t read_chars;
 	uint16_t len;
+	int fd;
 
-	snprintf(filename, PATH_MAX, "%s/%s", dir, "raw_data");
-	filename[PATH_MAX-1] = 0;
-
-	fp = fopen(filename, "r");
-	if (!fp) {
+	fd = openat(dfd, "raw_data", O_RDONLY);
+	if (fd < 0)
 		return -errno;
-	}
 
 	memset(edd_info->edd_device_params, 0, EDD_DEVICE_PARAM_SIZE);
-	read_chars = fread(edd_info->edd_device_params, sizeof(uint8_t),
-				EDD_DEVICE_PARAM_SIZE, fp);
-	fclose(fp);
+	read_chars = pread(fd, edd_info->edd_device_params,
+			   EDD_DEVICE_PARAM_SIZE, 0);
+	close(fd);
+	if (read_chars < 0)
+		read_chars = 0;
 
 	len = ((uint16_t *)edd_info->edd_device_params)[0];
 	dbgprintf("EDD raw data has length %d\n", len);
@@ -280,102 +287,106 @@ static int read_edd_raw_data(const char *dir, struct edd_info *edd_info)
 	return 0;
 }
 
-static int add_edd_entry(struct x86_linux_param_header *real_mode,
-		const char *sysfs_name, int *current_edd, int *current_mbr)
+/*
+ * EDD information as read from sysfs.  It does not change while the
+ * system is up, so it is read once (or taken from the firmware state
+ * cache) and copied into every zero page built afterwards.
+ */
+static struct {
+	int valid;
+	int present;
+	int nr_edd;
+	int nr_mbr;
+	struct edd_info edd[EDDMAXNR];
+	uint32_t mbr_sig[EDD_MBR_SIG_MAX];
+} edd_cache;
+
+static int add_edd_entry(int dfd, const char *sysfs_name)
 {
+	unsigned long long val;
 	uint8_t devnum, version;
-	uint32_t mbr_sig;
 	struct edd_info *edd_info;
 
-	if (!current_mbr || !current_edd) {
-		fprintf(stderr, "%s: current_edd and current_edd "
-				"must not be NULL", __FUNCTION__);
-		return -1;
-	}
+	if (edd_cache.nr_edd >= EDDMAXNR)
+		return 0;
 
-	edd_info = &real_mode->eddbuf[*current_edd];
+	edd_info = &edd_cache.edd[edd_cache.nr_edd];
 	memset(edd_info, 0, sizeof(struct edd_info));
 
 	/* extract the device number */
-	if (sscanf(basename(sysfs_name), "int13_dev%hhx", &devnum) != 1) {
+	if (sscanf(sysfs_name, "int13_dev%hhx", &devnum) != 1) {
 		fprintf(stderr, "Invalid format of int13_dev dir "
-				"entry: %s\n", basename(sysfs_name));
+				"entry: %s\n", sysfs_name);
 		return -1;
 	}
 
 	/* if there's a MBR signature, then add it */
-	if (file_scanf(sysfs_name, "mbr_signature", "0x%x", &mbr_sig) == 1) {
-		real_mode->edd_mbr_sig_buffer[*current_mbr] = mbr_sig;
-		(*current_mbr)++;
-		dbgprintf("EDD Device 0x%x: mbr_sig=0x%x\n", devnum, mbr_sig);
+	if (edd_cache.nr_mbr < EDD_MBR_SIG_MAX &&
+	    sysfs_read_ull(dfd, "mbr_signature", 16, &val) == 0) {
+		edd_cache.mbr_sig[edd_cache.nr_mbr++] = val;
+		dbgprintf("EDD Device 0x%x: mbr_sig=0x%x\n", devnum,
+			  (uint32_t)val);
 	}
 
 	/* set the device number */
 	edd_info->device = devnum;
 
 	/* set the version */
-	if (file_scanf(sysfs_name, "version", "0x%hhx", &version) != 1)
+	if (sysfs_read_ull(dfd, "version", 16, &val) != 0)
 		return -1;
 
+	version = val;
 	edd_info->version = version;
 
 	/* if version == 0, that's some kind of dummy entry */
 	if (version != 0) {
 		/* legacy_max_cylinder */
-		if (file_scanf(sysfs_name, "legacy_max_cylinder", "%hu",
-					&edd_info->legacy_max_cylinder) != 1) {
+		if (sysfs_read_ull(dfd, "legacy_max_cylinder", 10, &val) != 0) {
 			fprintf(stderr, "Reading legacy_max_cylinder failed.\n");
 			return -1;
 		}
+		edd_info->legacy_max_cylinder = val;
 
 		/* legacy_max_head */
-		if (file_scanf(sysfs_name, "legacy_max_head", "%hhu",
-					&edd_info->legacy_max_head) != 1) {
+		if (sysfs_read_ull(dfd, "legacy_max_head", 10, &val) != 0) {
 			fprintf(stderr, "Reading legacy_max_head failed.\n");
 			return -1;
 		}
+		edd_info->legacy_max_head = val;
 
 		/* legacy_sectors_per_track */
-		if (file_scanf(sysfs_name, "legacy_sectors_per_track", "%hhu",
-					&edd_info->legacy_sectors_per_track) != 1) {
+		if (sysfs_read_ull(dfd, "legacy_sectors_per_track", 10,
+				   &val) != 0) {
 			fprintf(stderr, "Reading legacy_sectors_per_track failed.\n");
 			return -1;
 		}
+		edd_info->legacy_sectors_per_track = val;
 
 		/* Parse the EDD extensions */
-		if (parse_edd_extensions(sysfs_name, edd_info) != 0) {
+		if (parse_edd_extensions(dfd, edd_info) != 0) {
 			fprintf(stderr, "Parsing EDD extensions failed.\n");
 			return -1;
 		}
 
 		/* Parse the raw info */
-		if (read_edd_raw_data(sysfs_name, edd_info) != 0) {
+		if (read_edd_raw_data(dfd, edd_info) != 0) {
 			fprintf(stderr, "Reading EDD raw data failed.\n");
 			return -1;
 		}
 	}
 
-	(*current_edd)++;
+	edd_cache.nr_edd++;
 
 	return 0;
 }
 
-static void zero_edd(struct x86_linux_param_header *real_mode)
-{
-	real_mode->eddbuf_entries = 0;
-	real_mode->edd_mbr_sig_buf_entries = 0;
-	memset(real_mode->eddbuf, 0,
-		EDDMAXNR * sizeof(struct edd_info));
-	memset(real_mode->edd_mbr_sig_buffer, 0,
-		EDD_MBR_SIG_MAX * sizeof(uint32_t));
-}
-
-void setup_edd_info(struct x86_linux_param_header *real_mode)
+static void read_edd_info(void)
 {
 	DIR *edd_dir;
 	struct dirent *cursor;
-	int current_edd = 0;
-	int current_mbr = 0;
+	int dfd, ret;
+
+	edd_cache.valid = 1;
 
 	edd_dir = opendir(EDD_SYFS_DIR);
 	if (!edd_dir) {
@@ -383,30 +394,60 @@ void setup_edd_info(struct x86_linux_param_header *real_mode)
 		return;
 	}
 
-	zero_edd(real_mode);
+	edd_cache.present = 1;
 	while ((cursor = readdir(edd_dir))) {
-		char full_dir_name[PATH_MAX];
-
 		/* only read the entries that start with "int13_dev" */
 		if (strstr(cursor->d_name, "int13_dev") != cursor->d_name)
 			continue;
 
-		snprintf(full_dir_name, PATH_MAX, "%s/%s",
-				EDD_SYFS_DIR, cursor->d_name);
-		full_dir_name[PATH_MAX-1] = 0;
-
-		if (add_edd_entry(real_mode, full_dir_name, &current_edd,
-					&current_mbr) != 0) {
-			zero_edd(real_mode);
-			goto out;
+		dfd = openat(dirfd(edd_dir), cursor->d_name,
+			     O_RDONLY | O_DIRECTORY);
+		ret = dfd < 0 ? -1 : add_edd_entry(dfd, cursor->d_name);
+		if (dfd >= 0)
+			close(dfd);
+		if (ret != 0) {
+			edd_cache.nr_edd = edd_cache.nr_mbr = 0;
+			break;
 		}
 	}
 
-	real_mode->eddbuf_entries = current_edd;
-	real_mode->edd_mbr_sig_buf_entries = current_mbr;
-
-out:
 	closedir(edd_dir);
+}
+
+static void zero_edd(struct x86_linux_param_header *real_mode)
+{
+	real_mode->eddbuf_entries = 0;
+	real_mode->edd_mbr_sig_buf_entries = 0;
+	memset(real_mode->eddbuf, 0,
+		EDDMAXNR * sizeof(struct edd_info));
+	memset(real_mode->edd_mbr_sig_buffer, 0,
+		EDD_MBR_SIG_MAX * sizeof(uint32_t));
+}
+
+void setup_edd_info(struct x86_linux_param_header *real_mode)
+{
+	const void *cached;
+	size_t size;
+
+	if (!edd_cache.valid) {
+		cached = fw_cache_get("x86-edd", &size);
+		if (cached && size == sizeof(edd_cache)) {
+			memcpy(&edd_cache, cached, size);
+		} else {
+			read_edd_info();
+			fw_cache_put("x86-edd", &edd_cache, sizeof(edd_cache));
+		}
+	}
+	if (!edd_cache.present)
+		return;
+
+	zero_edd(real_mode);
+	memcpy(real_mode->eddbuf, edd_cache.edd,
+	       edd_cache.nr_edd * sizeof(struct edd_info));
+	memcpy(real_mode->edd_mbr_sig_buffer, edd_cache.mbr_sig,
+	       edd_cache.nr_mbr * sizeof(uint32_t));
+	real_mode->eddbuf_entries = edd_cache.nr_edd;
+	real_mode->edd_mbr_sig_buf_entries = edd_cache.nr_mbr;
 
 	dbgprintf("Added %d EDD MBR entries and %d EDD entries.\n",
 		real_mode->edd_mbr_sig_buf_entries,
@@ -550,48 +591,85 @@ static int get_efi_values(struct efi_setup_data *esd)
 	return ret;
 }
 
-static int get_efi_runtime_map(struct efi_mem_descriptor **map)
+/*
+ * The EFI runtime map as read from sysfs; like the EDD information it
+ * is read once and reused.  nr_maps is -1 until it has been read.
+ */
+static struct {
+	int nr_maps;
+	struct efi_mem_descriptor *maps;
+} efi_rt_cache = { -1, NULL };
+
+static int read_efi_runtime_map(struct efi_mem_descriptor **map)
 {
 	DIR *dirp;
 	struct dirent *entry;
-	char filename[1024];
 	struct efi_mem_descriptor md, *p = NULL;
-	int nr_maps = 0;
+	unsigned long long val;
+	int nr_maps = 0, max_maps = 0;
+	int dfd;
 
 	dirp = opendir("/sys/firmware/efi/runtime-map");
 	if (!dirp)
 		return 0;
 	while ((entry = readdir(dirp)) != NULL) {
-		sprintf(filename,
-			"/sys/firmware/efi/runtime-map/%s",
-			(char *)entry->d_name);
 		if (*entry->d_name == '.')
 			continue;
-		file_scanf(filename, "type", "0x%x", (unsigned int *)&md.type);
-		file_scanf(filename, "phys_addr", "0x%llx",
-			   (unsigned long long *)&md.phys_addr);
-		file_scanf(filename, "virt_addr", "0x%llx",
-			   (unsigned long long *)&md.virt_addr);
-		file_scanf(filename, "num_pages", "0x%llx",
-			   (unsigned long long *)&md.num_pages);
-		file_scanf(filename, "attribute", "0x%llx",
-			   (unsigned long long *)&md.attribute);
-		p = realloc(p, (nr_maps + 1) * sizeof(md));
-		if (!p)
-			goto err_out;
-
-		*(p + nr_maps) = md;
-		*map = p;
-		nr_maps++;
+		dfd = openat(dirfd(dirp), entry->d_name,
+			     O_RDONLY | O_DIRECTORY);
+		if (dfd < 0)
+			continue;
+		memset(&md, 0, sizeof(md));
+		if (!sysfs_read_ull(dfd, "type", 16, &val))
+			md.type = val;
+		if (!sysfs_read_ull(dfd, "phys_addr", 16, &val))
+			md.phys_addr = val;
+		if (!sysfs_read_ull(dfd, "virt_addr", 16, &val))
+			md.virt_addr = val;
+		if (!sysfs_read_ull(dfd, "num_pages", 16, &val))
+			md.num_pages = val;
+		if (!sysfs_read_ull(dfd, "attribute", 16, &val))
+			md.attribute = val;
+		close(dfd);
+
+		if (nr_maps == max_maps) {
+			max_maps = max_maps ? max_maps * 2 : 32;
+			p = xrealloc(p, max_maps * sizeof(md));
+		}
+		p[nr_maps++] = md;
 	}
 
 	closedir(dirp);
+	*map = p;
 	return nr_maps;
-err_out:
-	if (map)
-		free(map);
-	closedir(dirp);
-	return 0;
+}
+
+/*
+ * Return the EFI runtime map in *map.  The array belongs to the cache
+ * and must not be freed.
+ */
+static int get_efi_runtime_map(struct efi_mem_descriptor **map)
+{
+	const void *cached;
+	size_t size;
+
+	if (efi_rt_cache.nr_maps < 0) {
+		cached = fw_cache_get("x86-efi-runtime-map", &size);
+		if (cached && size % sizeof(struct efi_mem_descriptor) == 0) {
+			efi_rt_cache.maps = xmalloc(size ? size : 1);
+			memcpy(efi_rt_cache.maps, cached, size);
+			efi_rt_cache.nr_maps = size /
+				sizeof(struct efi_mem_descriptor);
+		} else {
+			efi_rt_cache.nr_maps =
+				read_efi_runtime_map(&efi_rt_cache.maps);
+			fw_cache_put("x86-efi-runtime-map", efi_rt_cache.maps,
+				     efi_rt_cache.nr_maps *
+				     sizeof(struct efi_mem_descriptor));
+		}
+	}
+	*map = efi_rt_cache.maps;
+	return efi_rt_cache.nr_maps;
 }
 
 struct efi_info {
@@ -605,20 +683,94 @@ struct efi_info {
 	uint32_t efi_memmap_hi;
 };
 
+/*
+ * The setup_data nodes and the EFI runtime memmap are packed into one
+ * arena and placed with a single add_buffer() by place_setup_data(),
+ * rather than each costing a segment, a hole search and a page of
+ * padding.  Entries are kept 8 byte aligned.
+ */
+#define SETUP_DATA_MAX	8
+
+static struct {
+	char *buf;
+	size_t size;
+	size_t alloc;
+	size_t node[SETUP_DATA_MAX];	/* arena offsets, in order added */
+	int nr_nodes;
+	size_t efi_memmap;		/* arena offset + 1, 0 if none */
+} sd_arena;
+
+/* Reserve size zeroed bytes in the arena and return their offset */
+static size_t setup_data_alloc(size_t size)
+{
+	size_t offset = _ALIGN(sd_arena.size, 8);
+
+	if (offset + size > sd_arena.alloc) {
+		size_t alloc = sd_arena.alloc ? sd_arena.alloc : getpagesize();
+
+		while (alloc < offset + size)
+			alloc *= 2;
+		sd_arena.buf = xrealloc(sd_arena.buf, alloc);
+		memset(sd_arena.buf + sd_arena.alloc, 0,
+		       alloc - sd_arena.alloc);
+		sd_arena.alloc = alloc;
+	}
+	sd_arena.size = offset + size;
+	return offset;
+}
+
 /*
  * Add another instance to single linked list of struct setup_data.
  * Please refer to kernel Documentation/x86/boot.txt for more details
- * about setup_data structure.
+ * about setup_data structure.  The returned node is only valid until
+ * the next allocation from the arena; its next pointer is filled in by
+ * place_setup_data().
  */
-static void add_setup_data(struct kexec_info *info,
-			   struct x86_linux_param_header *real_mode,
-			   struct setup_data *sd)
+static struct setup_data *add_setup_data(uint32_t type, uint32_t len)
 {
-	int sdsize = sizeof(struct setup_data) + sd->len;
+	struct setup_data *sd;
+	size_t offset;
+
+	if (sd_arena.nr_nodes >= SETUP_DATA_MAX)
+		die("Too many setup_data entries\n");
+	offset = setup_data_alloc(sizeof(struct setup_data) + len);
+	sd_arena.node[sd_arena.nr_nodes++] = offset;
+	sd = (struct setup_data *)(sd_arena.buf + offset);
+	sd->type = type;
+	sd->len = len;
+	return sd;
+}
 
-	sd->next = real_mode->setup_data;
-	real_mode->setup_data = add_buffer(info, sd, sdsize, sdsize, getpagesize(),
-			    0x100000, ULONG_MAX, INT_MAX);
+/*
+ * Place the arena and chain its nodes in front of any setup_data the
+ * header already carries, newest first as the kernel walks them.
+ */
+static void place_setup_data(struct kexec_info *info,
+			     struct x86_linux_param_header *real_mode)
+{
+	struct efi_info *ei = (struct efi_info *)real_mode->efi_info;
+	struct setup_data *sd;
+	unsigned long addr;
+	uint64_t memmap_paddr;
+	int i;
+
+	if (!sd_arena.size)
+		return;
+
+	addr = add_buffer(info, sd_arena.buf, sd_arena.size, sd_arena.size,
+			  getpagesize(), 0x100000, ULONG_MAX, INT_MAX);
+
+	for (i = 0; i < sd_arena.nr_nodes; i++) {
+		sd = (struct setup_data *)(sd_arena.buf + sd_arena.node[i]);
+		sd->next = real_mode->setup_data;
+		real_mode->setup_data = addr + sd_arena.node[i];
+	}
+
+	if (sd_arena.efi_memmap) {
+		memmap_paddr = addr + sd_arena.efi_memmap - 1;
+		ei->efi_memmap = memmap_paddr & 0xffffffff;
+		ei->efi_memmap_hi = memmap_paddr >> 32;
+	}
 }
 
 /*
@@ -627,10 +779,9 @@ static void add_setup_data(struct kexec_info *info,
  *    setup_data.
  * 2) runtime memory regions, set the memmap related fields in efi_info.
  */
-static int setup_efi_data(struct kexec_info *info,
-			  struct x86_linux_param_header *real_mode)
+static int setup_efi_data(struct x86_linux_param_header *real_mode)
 {
-	int64_t memmap_paddr;
+	size_t offset;
 	struct setup_data *sd;
 	struct efi_setup_data *esd;
 	struct efi_mem_descriptor *maps;
@@ -655,32 +806,19 @@ static int setup_efi_data(struct kexec_info *info,
 		ret = 2;
 		goto free_esd;
 	}
-	sd = malloc(sizeof(struct setup_data) + sizeof(*esd));
-	if (!sd) {
-		ret = 3;
-		goto free_maps;
-	}
-
-	memset(sd, 0, sizeof(struct setup_data) + sizeof(*esd));
-	sd->next = 0;
-	sd->type = SETUP_EFI;
-	sd->len = sizeof(*esd);
+	sd = add_setup_data(SETUP_EFI, sizeof(*esd));
 	memcpy(sd->data, esd, sizeof(*esd));
 	free(esd);
 
-	add_setup_data(info, real_mode, sd);
-
+	/* the memmap address is filled in by place_setup_data() */
 	size = nr_maps * sizeof(struct efi_mem_descriptor);
-	memmap_paddr = add_buffer(info, maps, size, size, getpagesize(),
-					0x100000, ULONG_MAX, INT_MAX);
-	ei->efi_memmap = memmap_paddr & 0xffffffff;
-	ei->efi_memmap_hi = memmap_paddr >> 32;
+	offset = setup_data_alloc(size);
+	memcpy(sd_arena.buf + offset, maps, size);
+	sd_arena.efi_memmap = offset + 1;
 	ei->efi_memmap_size = size;
 	ei->efi_memdesc_size = sizeof(struct efi_mem_descriptor);
 
 	return 0;
-free_maps:
-	free(maps);
 free_esd:
 	free(esd);
 out:
@@ -731,7 +869,7 @@ static void add_e820_map_from_mr(struct x86_linux_param_header *real_mode,
 	}
 }
 
-static void setup_e820_ext(struct kexec_info *info, struct x86_linux_param_header *real_mode,
+static void setup_e820_ext(struct x86_linux_param_header *real_mode,
 			   struct memory_range *range, int nr_range)
 {
 	struct setup_data *sd;
@@ -739,15 +877,12 @@ static void setup_e820_ext(struct kexec_info *info, struct x86_linux_param_heade
 	int nr_range_ext;
 
 	nr_range_ext = nr_range - E820MAX;
-	sd = xmalloc(sizeof(struct setup_data) + nr_range_ext * sizeof(struct e820entry));
-	sd->next = 0;
-	sd->len = nr_range_ext * sizeof(struct e820entry);
-	sd->type = SETUP_E820_EXT;
+	sd = add_setup_data(SETUP_E820_EXT,
+			    nr_range_ext * sizeof(struct e820entry));
 
 	e820 = (struct e820entry *) sd->data;
 	dbgprintf("Extended E820 via setup_data:\n");
 	add_e820_map_from_mr(real_mode, e820, range + E820MAX, nr_range_ext);
-	add_setup_data(info, real_mode, sd);
 }
 
 static void setup_e820(struct kexec_info *info, struct x86_linux_param_header *real_mode)
@@ -775,7 +910,7 @@ static void setup_e820(struct kexec_info *info, struct x86_linux_param_header *r
 
 	if (nr_range_saved > E820MAX) {
 		dbgprintf("extra E820 memmap are passed via setup_data\n");
-		setup_e820_ext(info, real_mode, range, nr_range_saved);
+		setup_e820_ext(real_mode, range, nr_range_saved);
 	}
 }
 
@@ -787,8 +922,7 @@ get_efi_mem_desc_version(struct x86_linux_param_header *real_mode)
 	return ei->efi_memdesc_version;
 }
 
-static void setup_efi_info(struct kexec_info *info,
-			   struct x86_linux_param_header *real_mode)
+static void setup_efi_info(struct x86_linux_param_header *real_mode)
 {
 	int ret, desc_version;
 	off_t offset = offsetof(typeof(*real_mode), efi_info);
@@ -806,7 +940,7 @@ static void setup_efi_info(struct kexec_info *info,
 			desc_version);
 		goto out;
 	}
-	ret = setup_efi_data(info, real_mode);
+	ret = setup_efi_data(real_mode);
 	if (ret)
 		goto out;
 
@@ -820,10 +954,12 @@ out:
 void setup_linux_system_parameters(struct kexec_info *info,
 				   struct x86_linux_param_header *real_mode)
 {
+	memset(&sd_arena, 0, sizeof(sd_arena));
+
 	/* get subarch from running kernel */
 	setup_subarch(real_mode);
 	if (bzImage_support_efi_boot)
-		setup_efi_info(info, real_mode);
+		setup_efi_info(real_mode);
 	
 	/* Default screen size */
 	real_mode->orig_x = 0;
@@ -864,4 +1000,7 @@ void setup_linux_system_parameters(struct kexec_info *info,
 
 	/* fill the EDD information */
 	setup_edd_info(real_mode);
+
+	/* place everything queued as setup_data in one segment */
+	place_setup_data(info, real_mode);
 }
@@ -168,6 +168,7 @@ int elf_ia64_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 	command_line_len = 0;
 	if (command_line) {
 		command_line_len = strlen(command_line) + 16;
@@ -273,7 +274,7 @@ int elf_ia64_load(int argc, char **argv, const char *buf, off_t len,
 	}
 	
 	if (ramdisk) {
-		ramdisk_buf = slurp_file(ramdisk, &ramdisk_size);
+		ramdisk_buf = slurp_initrd(ramdisk, &ramdisk_size);
 		ramdisk_base = add_buffer(info, ramdisk_buf, ramdisk_size,
 				ramdisk_size,
 				getpagesize(), 0, max_addr, -1);
@@ -169,7 +169,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 
 /* Supported file types and callbacks */
 struct file_type file_type[] = {
-       {"elf-ia64", elf_ia64_probe, elf_ia64_load, elf_ia64_usage},
+       {"elf-ia64", elf_ia64_probe, elf_ia64_load, elf_ia64_usage,
+	KERNEL_MAGIC_ELF},
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
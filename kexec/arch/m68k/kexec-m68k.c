@@ -35,7 +35,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 
 
 struct file_type file_type[] = {
-	{"elf-m68k", elf_m68k_probe, elf_m68k_load, elf_m68k_usage},
+	{"elf-m68k", elf_m68k_probe, elf_m68k_load, elf_m68k_usage,
+	 KERNEL_MAGIC_ELF},
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
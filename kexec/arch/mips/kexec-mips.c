@@ -68,7 +68,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 }
 
 struct file_type file_type[] = {
-	{"elf-mips", elf_mips_probe, elf_mips_load, elf_mips_usage},
+	{"elf-mips", elf_mips_probe, elf_mips_load, elf_mips_usage,
+	 KERNEL_MAGIC_ELF},
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
@@ -13,10 +13,14 @@
 #include "ops.h"
 #include "page.h"
 #include "fixup_dtb.h"
+#include "../../dtb_edit.h"
 #include "kexec-ppc.h"
 
 const char proc_dts[] = "/proc/device-tree";
 
+/* The device tree being fixed up, from fixup_dtb_init() on */
+static struct dtb_edit dtb;
+
 static void print_fdt_reserve_regions(char *blob_buf)
 {
 	int i, num;
@@ -113,27 +117,6 @@ static void fixup_cmdline(const char *cmdline)
 	return;
 }
 
-#define EXPAND_GRANULARITY     1024
-
-static char *expand_buf(int minexpand, char *blob_buf, off_t *blob_size)
-{
-	int size = fdt_totalsize(blob_buf);
-	int rc;
-
-	size = _ALIGN(size + minexpand, EXPAND_GRANULARITY);
-	blob_buf = realloc(blob_buf, size);
-	if (!blob_buf)
-		die("Couldn't find %d bytes to expand device tree\n\r", size);
-	rc = fdt_open_into(blob_buf, blob_buf, size);
-	if (rc != 0)
-		die("Couldn't expand fdt into new buffer: %s\n\r",
-			fdt_strerror(rc));
-
-	*blob_size = fdt_totalsize(blob_buf);
-
-	return blob_buf;
-}
-
 static void fixup_reserve_regions(struct kexec_info *info, char *blob_buf)
 {
 	int ret, i;
@@ -262,10 +245,12 @@ static void fixup_memory(struct kexec_info *info, char *blob_buf)
 			len += 4;
 		}
 
-		if (fdt_setprop(blob_buf, nodeoffset, "reg", tmp, len) != 0) {
+		if (dtb_edit_setprop(&dtb, "/memory", "reg", tmp, len) != 0) {
 			printf ("Error setting memory node!\n");
 		}
 
+		blob_buf = dtb.buf;
+		nodeoffset = fdt_path_offset(blob_buf, "/memory");
 		fdt_delprop(blob_buf, nodeoffset, "linux,usable-memory");
 	}
 }
@@ -295,7 +280,7 @@ static void fixup_crashkernel(struct kexec_info *info, char *blob_buf)
  */
 static void fixup_initrd(char *blob_buf)
 {
-	int err, nodeoffset;
+	int nodeoffset;
 	unsigned long tmp;
 
 	nodeoffset = fdt_path_offset(blob_buf, "/chosen");
@@ -311,21 +296,16 @@ static void fixup_initrd(char *blob_buf)
 	if ((reuse_initrd || ramdisk) &&
 	   ((ramdisk_base != 0) && (ramdisk_size != 0))) {
 		tmp = ramdisk_base;
-		err = fdt_setprop(blob_buf, nodeoffset,
-			"linux,initrd-start", &tmp, sizeof(tmp));
-		if (err < 0) {
-			printf("WARNING: "
-				"could not set linux,initrd-start %s.\n",
-				fdt_strerror(err));
+		if (dtb_edit_setprop(&dtb, "/chosen",
+			"linux,initrd-start", &tmp, sizeof(tmp)) < 0) {
+			printf("WARNING: could not set linux,initrd-start.\n");
 				return;
 		}
 
 		tmp = ramdisk_base + ramdisk_size;
-		err = fdt_setprop(blob_buf, nodeoffset,
-			"linux,initrd-end", &tmp, sizeof(tmp));
-		if (err < 0) {
-			printf("WARNING: could not set linux,initrd-end %s.\n",
-				fdt_strerror(err));
+		if (dtb_edit_setprop(&dtb, "/chosen",
+			"linux,initrd-end", &tmp, sizeof(tmp)) < 0) {
+			printf("WARNING: could not set linux,initrd-end.\n");
 				return;
 		}
 	}
@@ -334,12 +314,17 @@ static void fixup_initrd(char *blob_buf)
 char *fixup_dtb_init(struct kexec_info *info, char *blob_buf, off_t *blob_size,
 			unsigned long hole_addr, unsigned long *dtb_addr)
 {
-	int ret, i, num = fdt_num_mem_rsv(blob_buf);
+	int ret, i, num;
 
-	fdt_init(blob_buf);
+	/* info->nr_segments just a guide, the edit session grows as needed */
+	dtb_edit_open(&dtb, blob_buf,
+		      info->nr_segments * sizeof(struct fdt_reserve_entry));
+	fdt_init(&dtb);
+	blob_buf = dtb.buf;
 
 	/* Remove the existing reserve regions as they will no longer
 	 * be valid after we reboot */
+	num = fdt_num_mem_rsv(blob_buf);
 	for (i = num - 1; i >= 0; i--) {
 		ret = fdt_del_mem_rsv(blob_buf, i);
 		if (ret) {
@@ -347,15 +332,7 @@ char *fixup_dtb_init(struct kexec_info *info, char *blob_buf, off_t *blob_size,
 					fdt_strerror(ret), i);
 		}
 	}
-
-	/* Pack the FDT first, so we don't grow excessively if there is already free space */
-	ret = fdt_pack(blob_buf);
-	if (ret)
-		printf("%s: Unable to pack flat device tree\n", fdt_strerror(ret));
-
-	/* info->nr_segments just a guide, will grow by at least EXPAND_GRANULARITY */
-	blob_buf = expand_buf(info->nr_segments * sizeof(struct fdt_reserve_entry),
-				 blob_buf, blob_size);
+	*blob_size = dtb.size;
 
 	/* add reserve region for *THIS* fdt */
 	*dtb_addr = locate_hole(info, *blob_size, 0,
@@ -392,10 +369,11 @@ char *fixup_dtb_finalize(struct kexec_info *info, char *blob_buf, off_t *blob_si
 {
 	fixup_nodes(nodes);
 	fixup_cmdline(cmdline);
-	fixup_reserve_regions(info, blob_buf);
-	fixup_memory(info, blob_buf);
-	fixup_initrd(blob_buf);
-	fixup_crashkernel(info, blob_buf);
+	/* The blob may have been moved to make room for the above */
+	fixup_reserve_regions(info, dtb.buf);
+	fixup_memory(info, dtb.buf);
+	fixup_initrd(dtb.buf);
+	fixup_crashkernel(info, dtb.buf);
 
 	blob_buf = (char *)dt_ops.finalize();
 	*blob_size = fdt_totalsize(blob_buf);
@@ -29,17 +29,17 @@
 #include <errno.h>
 #include <stdio.h>
 #include "../../kexec.h"
+#include "../../dt_strings.h"
 #include "kexec-ppc.h"
 
 #define MAXPATH			1024	/* max path name length */
-#define NAMESPACE		16384	/* max bytes for property names */
 #define TREEWORDS		65536	/* max 32 bit words for properties */
 #define MEMRESERVE		256	/* max number of reserved memory blks */
 #define MAX_MEMORY_RANGES	1024
 #define COMMAND_LINE_SIZE	512	/* from kernel */
 
 static char pathname[MAXPATH];
-static char propnames[NAMESPACE] = { 0 };
+static struct dt_strings propnames;
 static unsigned dtstruct[TREEWORDS], *dt;
 static unsigned long long mem_rsrv[2*MEMRESERVE] = { 0, 0 };
 
@@ -106,20 +106,7 @@ static void checkprop(char *name, unsigned *data, int len)
  */
 static unsigned propnum(const char *name)
 {
-	unsigned offset = 0;
-
-	while (propnames[offset])
-		if (strcmp(name, propnames+offset))
-			offset += strlen(propnames+offset)+1;
-		else
-			return offset;
-
-	if (NAMESPACE - offset < strlen(name) + 1)
-		die("unrecoverable error: propnames overrun\n");
-
-	strcpy(propnames+offset, name);
-
-	return offset;
+	return dt_strings_add(&propnames, name);
 }
 
 static void add_usable_mem_property(int fd, int len)
@@ -433,7 +420,7 @@ int create_flatten_tree(struct kexec_info *info, unsigned char **bufp,
 	bb->dt_struct_size = len;
 	bb->off_dt_strings = bb->off_dt_struct + len;
 
-	len = propnum("");
+	len = propnames.size;
 	bb->dt_strings_size = len;
 	len = _ALIGN(len, 4);
 	bb->totalsize = bb->off_dt_strings + len;
@@ -452,7 +439,7 @@ int create_flatten_tree(struct kexec_info *info, unsigned char **bufp,
 	tlen = tlen + (bb->off_dt_struct - bb->off_mem_rsvmap);
 	memcpy(buf+tlen, dtstruct,  bb->off_dt_strings - bb->off_dt_struct);
 	tlen = tlen +  (bb->off_dt_strings - bb->off_dt_struct);
-	memcpy(buf+tlen, propnames,  bb->totalsize - bb->off_dt_strings);
+	memcpy(buf+tlen, propnames.buf,  bb->totalsize - bb->off_dt_strings);
 	tlen = tlen + bb->totalsize - bb->off_dt_strings;
 	*sizep = tlen;
 	return 0;
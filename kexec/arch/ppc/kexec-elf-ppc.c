@@ -392,7 +392,7 @@ int elf_ppc_load(int argc, char **argv,	const char *buf, off_t len,
 
 	/* Perform final fixup on devie tree, i.e. everything beside what
 	 * was done above */
-	fixup_dtb_finalize(info, blob_buf, &blob_size, fixup_nodes,
+	blob_buf = fixup_dtb_finalize(info, blob_buf, &blob_size, fixup_nodes,
 			cmdline_buf);
 	dtb_addr_actual = add_buffer(info, blob_buf, blob_size, blob_size, 0, dtb_addr,
 			kernel_addr + KERNEL_ACCESS_TOP, 1);
@@ -910,9 +910,11 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 }
 
 struct file_type file_type[] = {
-	{"elf-ppc", elf_ppc_probe, elf_ppc_load, elf_ppc_usage},
+	{"elf-ppc", elf_ppc_probe, elf_ppc_load, elf_ppc_usage,
+	 KERNEL_MAGIC_ELF},
 	{"dol-ppc", dol_ppc_probe, dol_ppc_load, dol_ppc_usage},
-	{"uImage-ppc", uImage_ppc_probe, uImage_ppc_load, uImage_ppc_usage },
+	{"uImage-ppc", uImage_ppc_probe, uImage_ppc_load, uImage_ppc_usage,
+	 KERNEL_MAGIC_UIMAGE },
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
@@ -255,7 +255,7 @@ static int ppc_load_bare_bits(int argc, char **argv, const char *buf,
 
 	/* Perform final fixup on devie tree, i.e. everything beside what
 	 * was done above */
-	fixup_dtb_finalize(info, blob_buf, &blob_size, fixup_nodes,
+	blob_buf = fixup_dtb_finalize(info, blob_buf, &blob_size, fixup_nodes,
 			cmdline_buf);
 	dtb_addr_actual = add_buffer(info, blob_buf, blob_size, blob_size, 0, dtb_addr,
 			load_addr + KERNEL_ACCESS_TOP, 1);
@@ -28,6 +28,7 @@
 #include <libfdt.h>
 #include "ops.h"
 #include "../../kexec.h"
+#include "../../dtb_edit.h"
 
 #define BAD_ERROR(err)	(((err) < 0) \
 			 && ((err) != -FDT_ERR_NOTFOUND) \
@@ -52,32 +53,12 @@
 #define devp_offset_find(devp)	(((int)(devp))-1)
 #define devp_offset(devp)	(devp ? ((int)(devp))-1 : 0)
 
-static void *fdt;
-static void *buf; /* = NULL */
+static struct dtb_edit *dtb;
 struct dt_ops dt_ops;
 
-#define EXPAND_GRANULARITY	1024
-
-static void expand_buf(int minexpand)
-{
-	int size = fdt_totalsize(fdt);
-	int rc;
-
-	size = _ALIGN(size + minexpand, EXPAND_GRANULARITY);
-	buf = realloc(buf, size);
-	if (!buf)
-		die("Couldn't find %d bytes to expand device tree\n\r", size);
-	rc = fdt_open_into(fdt, buf, size);
-	if (rc != 0)
-		die("Couldn't expand fdt into new buffer: %s\n\r",
-		      fdt_strerror(rc));
-
-	fdt = buf;
-}
-
 static void *fdt_wrapper_finddevice(const char *path)
 {
-	return offset_devp(fdt_path_offset(fdt, path));
+	return offset_devp(fdt_path_offset(dtb->buf, path));
 }
 
 static int fdt_wrapper_getprop(const void *devp, const char *name,
@@ -86,7 +67,7 @@ static int fdt_wrapper_getprop(const void *devp, const char *name,
 	const void *p;
 	int len;
 
-	p = fdt_getprop(fdt, devp_offset(devp), name, &len);
+	p = fdt_getprop(dtb->buf, devp_offset(devp), name, &len);
 	if (!p)
 		return check_err(len);
 	memcpy(buf, p, min(len, buflen));
@@ -98,10 +79,10 @@ static int fdt_wrapper_setprop(const void *devp, const char *name,
 {
 	int rc;
 
-	rc = fdt_setprop(fdt, devp_offset(devp), name, buf, len);
+	rc = fdt_setprop(dtb->buf, devp_offset(devp), name, buf, len);
 	if (rc == -FDT_ERR_NOSPACE) {
-		expand_buf(len + 16);
-		rc = fdt_setprop(fdt, devp_offset(devp), name, buf, len);
+		dtb_edit_grow(dtb, len + 16);
+		rc = fdt_setprop(dtb->buf, devp_offset(devp), name, buf, len);
 	}
 
 	return check_err(rc);
@@ -109,17 +90,17 @@ static int fdt_wrapper_setprop(const void *devp, const char *name,
 
 static void *fdt_wrapper_get_parent(const void *devp)
 {
-	return offset_devp(fdt_parent_offset(fdt, devp_offset(devp)));
+	return offset_devp(fdt_parent_offset(dtb->buf, devp_offset(devp)));
 }
 
 static void *fdt_wrapper_create_node(const void *devp, const char *name)
 {
 	int offset;
 
-	offset = fdt_add_subnode(fdt, devp_offset(devp), name);
+	offset = fdt_add_subnode(dtb->buf, devp_offset(devp), name);
 	if (offset == -FDT_ERR_NOSPACE) {
-		expand_buf(strlen(name) + 16);
-		offset = fdt_add_subnode(fdt, devp_offset(devp), name);
+		dtb_edit_grow(dtb, strlen(name) + 16);
+		offset = fdt_add_subnode(dtb->buf, devp_offset(devp), name);
 	}
 
 	return offset_devp(offset);
@@ -130,7 +111,8 @@ static void *fdt_wrapper_find_node_by_prop_value(const void *prev,
 						 const char *val,
 						 int len)
 {
-	int offset = fdt_node_offset_by_prop_value(fdt, devp_offset_find(prev),
+	int offset = fdt_node_offset_by_prop_value(dtb->buf,
+						   devp_offset_find(prev),
 						   name, val, len);
 	return offset_devp(offset);
 }
@@ -138,7 +120,8 @@ static void *fdt_wrapper_find_node_by_prop_value(const void *prev,
 static void *fdt_wrapper_find_node_by_compatible(const void *prev,
 						 const char *val)
 {
-	int offset = fdt_node_offset_by_compatible(fdt, devp_offset_find(prev),
+	int offset = fdt_node_offset_by_compatible(dtb->buf,
+						   devp_offset_find(prev),
 						   val);
 	return offset_devp(offset);
 }
@@ -147,7 +130,7 @@ static char *fdt_wrapper_get_path(const void *devp, char *buf, int len)
 {
 	int rc;
 
-	rc = fdt_get_path(fdt, devp_offset(devp), buf, len);
+	rc = fdt_get_path(dtb->buf, devp_offset(devp), buf, len);
 	if (check_err(rc))
 		return NULL;
 	return buf;
@@ -155,20 +138,12 @@ static char *fdt_wrapper_get_path(const void *devp, char *buf, int len)
 
 static unsigned long fdt_wrapper_finalize(void)
 {
-	int rc;
-
-	rc = fdt_pack(fdt);
-	if (rc != 0)
-		die("Couldn't pack flat tree: %s\n\r",
-		      fdt_strerror(rc));
-	return (unsigned long)fdt;
+	return (unsigned long)dtb_edit_close(dtb, NULL);
 }
 
-void fdt_init(void *blob)
+/* Route dt_ops to a device tree opened with dtb_edit_open() */
+void fdt_init(struct dtb_edit *ed)
 {
-	int err;
-	int bufsize;
-
 	dt_ops.finddevice = fdt_wrapper_finddevice;
 	dt_ops.getprop = fdt_wrapper_getprop;
 	dt_ops.setprop = fdt_wrapper_setprop;
@@ -179,11 +154,5 @@ void fdt_init(void *blob)
 	dt_ops.get_path = fdt_wrapper_get_path;
 	dt_ops.finalize = fdt_wrapper_finalize;
 
-	/* Make sure the dt blob is the right version and so forth */
-	fdt = blob;
-	bufsize = fdt_totalsize(fdt);
-
-	err = fdt_open_into(fdt, fdt, bufsize);
-	if (err != 0)
-		die("fdt_init(): %s\n\r", fdt_strerror(err));
+	dtb = ed;
 }
@@ -38,7 +38,8 @@ struct dt_ops {
 };
 extern struct dt_ops dt_ops;
 
-void fdt_init(void *blob);
+struct dtb_edit;
+void fdt_init(struct dtb_edit *ed);
 extern void flush_cache(void *, unsigned long);
 int dt_xlate_reg(void *node, int res, unsigned long *addr, unsigned long *size);
 int dt_xlate_addr(void *node, u32 *buf, int buflen, unsigned long *xlated_addr);
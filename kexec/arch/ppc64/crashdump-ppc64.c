@@ -118,40 +118,43 @@ static void exclude_crash_region(uint64_t start, uint64_t end)
 static int get_dyn_reconf_crash_memory_ranges(void)
 {
 	uint64_t start, end;
-	char fname[128], buf[32];
-	FILE *file;
+	char fname[128], *buf, *lmb;
+	off_t size, nread;
 	unsigned int i;
-	int n;
 	uint32_t flags;
 
 	strcpy(fname, "/proc/device-tree/");
 	strcat(fname, "ibm,dynamic-reconfiguration-memory/ibm,dynamic-memory");
-	if ((file = fopen(fname, "r")) == NULL) {
-		perror(fname);
+
+	/* Pull in the whole property at once; it holds a 24 byte entry
+	 * for each of potentially hundreds of thousands of LMBs.
+	 */
+	size = 4 + (off_t)num_of_lmbs * 24;
+	buf = slurp_file_len(fname, size, &nread);
+	if (!buf)
+		return -1;
+	if (nread != size) {
+		fprintf(stderr, "%s: short read\n", fname);
+		free(buf);
 		return -1;
 	}
 
-	fseek(file, 4, SEEK_SET);
-	for (i = 0; i < num_of_lmbs; i++) {
-		if ((n = fread(buf, 1, 24, file)) < 0) {
-			perror(fname);
-			fclose(file);
-			return -1;
-		}
+	for (i = 0, lmb = buf + 4; i < num_of_lmbs; i++, lmb += 24) {
 		if (memory_ranges >= (max_memory_ranges + 1)) {
 			/* No space to insert another element. */
 				fprintf(stderr,
 				"Error: Number of crash memory ranges"
 				" excedeed the max limit\n");
+			free(buf);
 			return -1;
 		}
 
-		start = be64_to_cpu(((uint64_t *)buf)[DRCONF_ADDR]);
+		start = be64_to_cpu(((uint64_t *)lmb)[DRCONF_ADDR]);
 		end = start + lmb_size;
 		if (start == 0 && end >= (BACKUP_SRC_END + 1))
 			start = BACKUP_SRC_END + 1;
 
-		flags = be32_to_cpu((*((uint32_t *)&buf[DRCONF_FLAGS])));
+		flags = be32_to_cpu((*((uint32_t *)&lmb[DRCONF_FLAGS])));
 		/* skip this block if the reserved bit is set in flags (0x80)
 		   or if the block is not assigned to this partition (0x8) */
 		if ((flags & 0x80) || !(flags & 0x8))
@@ -159,7 +162,7 @@ static int get_dyn_reconf_crash_memory_ranges(void)
 
 		exclude_crash_region(start, end);
 	}
-	fclose(file);
+	free(buf);
 	return 0;
 }
 
@@ -96,7 +96,7 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 {
 	struct mem_ehdr ehdr;
 	char *cmdline, *modified_cmdline = NULL;
-	const char *devicetreeblob;
+	const char *devicetreeblob, *dt_base;
 	int cmdline_len, modified_cmdline_len;
 	uint64_t max_addr, hole_addr;
 	char *seg_buf = NULL;
@@ -127,6 +127,7 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 		{ "devicetreeblob",     1, NULL, OPT_DEVICETREEBLOB },
 		{ "dtb",                1, NULL, OPT_DEVICETREEBLOB },
 		{ "args-linux",		0, NULL, OPT_ARGS_IGNORE },
+		{ "dt-base",		1, NULL, OPT_DT_BASE },
 		{ 0,                    0, NULL, 0 },
 	};
 
@@ -138,6 +139,7 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 	cmdline = 0;
 	ramdisk = 0;
 	devicetreeblob = 0;
+	dt_base = 0;
 	max_addr = 0xFFFFFFFFFFFFFFFFULL;
 	hole_addr = 0;
 
@@ -159,8 +161,12 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		case OPT_ARGS_IGNORE:
 			break;
+		case OPT_DT_BASE:
+			dt_base = optarg;
+			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 
 	cmdline_len = 0;
 	if (cmdline)
@@ -235,7 +241,7 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 			"Can't use ramdisk with device tree blob input\n");
 			return -1;
 		}
-		seg_buf = slurp_file(ramdisk, &seg_size);
+		seg_buf = slurp_initrd(ramdisk, &seg_size);
 		hole_addr = add_buffer(info, seg_buf, seg_size, seg_size,
 			0, 0, max_addr, 1);
 		initrd_base = hole_addr;
@@ -245,6 +251,9 @@ int elf_ppc64_load(int argc, char **argv, const char *buf, off_t len,
 	if (devicetreeblob) {
 		/* Grab device tree from buffer */
 		seg_buf = slurp_file(devicetreeblob, &seg_size);
+	} else if (dt_base) {
+		/* edit a flattened tree of the running system */
+		fixup_flatten_tree(dt_base, &seg_buf, &seg_size, cmdline);
 	} else {
 		/* create from fs2dt */
 		create_flatten_tree(&seg_buf, &seg_size, cmdline);
@@ -392,6 +401,11 @@ void elf_ppc64_usage(void)
 	fprintf(stderr, "     --initrd=<filename> same as --ramdisk.\n");
 	fprintf(stderr, "     --devicetreeblob=<filename> Specify device tree blob file.\n");
 	fprintf(stderr, "     --dtb=<filename> same as --devicetreeblob.\n");
+	fprintf(stderr, "     --dt-base=<filename> Build the device tree by editing\n"
+			"                          a current blob of the running system\n"
+			"                          rather than reading /proc/device-tree.\n"
+			"                          /sys/firmware/fdt is only right if\n"
+			"                          nothing was hotplugged since boot.\n");
 
 	fprintf(stderr, "elf support is still broken\n");
 }
@@ -30,6 +30,7 @@
 #include <getopt.h>
 #include "../../kexec.h"
 #include "../../kexec-syscall.h"
+#include "../../firmware_memmap.h"
 #include "kexec-ppc64.h"
 #include "crashdump-ppc64.h"
 #include <arch/options.h>
@@ -147,10 +148,9 @@ static void add_base_memory_range(uint64_t start, uint64_t end)
 static int get_dyn_reconf_base_ranges(void)
 {
 	uint64_t start, end;
-	char fname[128], buf[32];
+	char fname[128], buf[32], *lmbs;
 	FILE *file;
 	unsigned int i;
-	int n;
 
 	strcpy(fname, "/proc/device-tree/");
 	strcat(fname, "ibm,dynamic-reconfiguration-memory/ibm,lmb-size");
@@ -185,20 +185,32 @@ static int get_dyn_reconf_base_ranges(void)
 	}
 	num_of_lmbs = be32_to_cpu(((unsigned int *)buf)[0]);
 
+	/* Read all the LMB entries in one go rather than one fread per LMB */
+	lmbs = malloc((size_t)num_of_lmbs * 24);
+	if (num_of_lmbs && !lmbs) {
+		fprintf(stderr, "Can't allocate %u LMB entries\n", num_of_lmbs);
+		fclose(file);
+		return -1;
+	}
+	if (fread(lmbs, 24, num_of_lmbs, file) != num_of_lmbs) {
+		perror(fname);
+		free(lmbs);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
 	for (i = 0; i < num_of_lmbs; i++) {
-		if ((n = fread(buf, 1, 24, file)) < 0) {
-			perror(fname);
-			fclose(file);
+		if (nr_memory_ranges >= max_memory_ranges) {
+			free(lmbs);
 			return -1;
 		}
-		if (nr_memory_ranges >= max_memory_ranges)
-			return -1;
 
-		start = be64_to_cpu(((uint64_t *)buf)[0]);
+		start = be64_to_cpu(((uint64_t *)(lmbs + i * 24))[0]);
 		end = start + lmb_size;
 		add_base_memory_range(start, end);
 	}
-	fclose(file);
+	free(lmbs);
 	return 0;
 }
 /* Sort the base ranges in memory - this is useful for ensuring that our
@@ -207,21 +219,11 @@ static int get_dyn_reconf_base_ranges(void)
  */
 static int sort_base_ranges(void)
 {
-	int i, j;
-	unsigned long long tstart, tend;
-
-	for (i = 0; i < nr_memory_ranges - 1; i++) {
-		for (j = 0; j < nr_memory_ranges - i - 1; j++) {
-			if (base_memory_range[j].start > base_memory_range[j+1].start) {
-				tstart = base_memory_range[j].start;
-				tend = base_memory_range[j].end;
-				base_memory_range[j].start = base_memory_range[j+1].start;
-				base_memory_range[j].end = base_memory_range[j+1].end;
-				base_memory_range[j+1].start = tstart;
-				base_memory_range[j+1].end = tend;
-			}
-		}
-	}
+	/* There is one base range per LMB on dynamic reconfiguration
+	 * systems, far too many for an exchange sort.
+	 */
+	qsort(base_memory_range, nr_memory_ranges, sizeof(struct memory_range),
+	      compare_ranges);
 	return 0;
 }
 
@@ -776,7 +778,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 }
 
 struct file_type file_type[] = {
-	{ "elf-ppc64", elf_ppc64_probe, elf_ppc64_load, elf_ppc64_usage },
+	{ "elf-ppc64", elf_ppc64_probe, elf_ppc64_load, elf_ppc64_usage,
+	  KERNEL_MAGIC_ELF },
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
@@ -49,8 +49,8 @@ int
 image_s390_load(int argc, char **argv, const char *kernel_buf,
 		off_t kernel_size, struct kexec_info *info)
 {
-	void *krnl_buffer;
-	char *rd_buffer;
+	char *krnl_buffer;
+	const char *rd_buffer;
 	const char *ramdisk;
 	off_t ramdisk_len;
 	unsigned int ramdisk_origin;
@@ -81,6 +81,16 @@ image_s390_load(int argc, char **argv, const char *kernel_buf,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
+
+	if (info->file_mode) {
+		/* The kernel does the rest */
+		if (ramdisk)
+			info->initrd_fd = open_initrd(ramdisk);
+		info->command_line = command_line;
+		info->command_line_len = strlen(command_line) + 1;
+		return 0;
+	}
 
 	if (info->kexec_flags & KEXEC_ON_CRASH) {
 		if (parse_iomem_single("Crash kernel\n", &crash_base,
@@ -88,20 +98,30 @@ image_s390_load(int argc, char **argv, const char *kernel_buf,
 			return -1;
 	}
 
-	/* Add kernel segment */
-	add_segment_check(info, kernel_buf + IMAGE_READ_OFFSET,
-		    kernel_size - IMAGE_READ_OFFSET, IMAGE_READ_OFFSET,
-		    kernel_size - IMAGE_READ_OFFSET);
-
-	/* We do want to change the kernel image */
-	krnl_buffer = (void *) kernel_buf + IMAGE_READ_OFFSET;
+	/*
+	 * Add kernel segments.  The ramdisk, oldmem and command line fields
+	 * are patched in a copy of the image's first page, which is loaded
+	 * as its own segment; the rest of kernel_buf is loaded as it is.
+	 */
+	krnl_buffer = xmalloc(IMAGE_PARM_PAGE);
+	memset(krnl_buffer, 0, IMAGE_PARM_PAGE);
+	memcpy(krnl_buffer, kernel_buf + IMAGE_READ_OFFSET,
+	       MIN(kernel_size - IMAGE_READ_OFFSET, IMAGE_PARM_PAGE));
+	add_segment_check(info, krnl_buffer, IMAGE_PARM_PAGE,
+			  IMAGE_READ_OFFSET, IMAGE_PARM_PAGE);
+	if (kernel_size > IMAGE_READ_OFFSET + IMAGE_PARM_PAGE)
+		add_segment_check(info,
+			kernel_buf + IMAGE_READ_OFFSET + IMAGE_PARM_PAGE,
+			kernel_size - IMAGE_READ_OFFSET - IMAGE_PARM_PAGE,
+			IMAGE_READ_OFFSET + IMAGE_PARM_PAGE,
+			kernel_size - IMAGE_READ_OFFSET - IMAGE_PARM_PAGE);
 
 	/*
 	 * Load ramdisk if present: If image is larger than RAMDISK_ORIGIN_ADDR,
 	 * we load the ramdisk directly behind the image with 1 MiB alignment.
 	 */
 	if (ramdisk) {
-		rd_buffer = slurp_file(ramdisk, &ramdisk_len);
+		rd_buffer = map_initrd(ramdisk, &ramdisk_len);
 		if (rd_buffer == NULL) {
 			fprintf(stderr, "Could not read ramdisk.\n");
 			return -1;
@@ -122,17 +142,17 @@ image_s390_load(int argc, char **argv, const char *kernel_buf,
 	{
 		unsigned long long *tmp;
 
-		tmp = krnl_buffer + INITRD_START_OFFS;
+		tmp = (void *) (krnl_buffer + INITRD_START_OFFS);
 		*tmp = (unsigned long long) ramdisk_origin;
 
-		tmp = krnl_buffer + INITRD_SIZE_OFFS;
+		tmp = (void *) (krnl_buffer + INITRD_SIZE_OFFS);
 		*tmp = (unsigned long long) ramdisk_len;
 
 		if (info->kexec_flags & KEXEC_ON_CRASH) {
-			tmp = krnl_buffer + OLDMEM_BASE_OFFS;
+			tmp = (void *) (krnl_buffer + OLDMEM_BASE_OFFS);
 			*tmp = crash_base;
 
-			tmp = krnl_buffer + OLDMEM_SIZE_OFFS;
+			tmp = (void *) (krnl_buffer + OLDMEM_SIZE_OFFS);
 			*tmp = crash_end - crash_base + 1;
 		}
 	}
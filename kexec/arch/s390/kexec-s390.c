@@ -226,7 +226,8 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 
 /* Supported file types and callbacks */
 struct file_type file_type[] = {
-	{ "image", image_s390_probe, image_s390_load, image_s390_usage},
+	{ "image", image_s390_probe, image_s390_load, image_s390_usage,
+	  0, FILE_TYPE_FILE_LOAD },
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
 
@@ -11,6 +11,7 @@
 #define KEXEC_S390_H
 
 #define IMAGE_READ_OFFSET     0x10000
+#define IMAGE_PARM_PAGE       0x1000	/* image page holding the fields below */
 
 #define RAMDISK_ORIGIN_ADDR   0x800000
 #define INITRD_START_OFFS     0x408
@@ -75,9 +75,11 @@ int get_memory_ranges(struct memory_range **range, int *ranges,
 struct file_type file_type[] = {
 	/* uImage is probed before zImage because the latter also accepts
 	   uncompressed images. */
-	{ "uImage-sh", uImage_sh_probe, uImage_sh_load, zImage_sh_usage },
+	{ "uImage-sh", uImage_sh_probe, uImage_sh_load, zImage_sh_usage,
+	  KERNEL_MAGIC_UIMAGE },
 	{ "zImage-sh", zImage_sh_probe, zImage_sh_load, zImage_sh_usage },
-	{ "elf-sh", elf_sh_probe, elf_sh_load, elf_sh_usage },
+	{ "elf-sh", elf_sh_probe, elf_sh_load, elf_sh_usage,
+	  KERNEL_MAGIC_ELF },
 	{ "netbsd-sh", netbsd_sh_probe, netbsd_sh_load, netbsd_sh_usage },
 };
 int file_types = sizeof(file_type) / sizeof(file_type[0]);
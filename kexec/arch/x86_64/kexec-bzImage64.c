@@ -284,6 +284,7 @@ int bzImage64_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 	command_line = concat_cmdline(tmp_cmdline, append);
 	if (tmp_cmdline)
 		free(tmp_cmdline);
@@ -294,9 +295,19 @@ int bzImage64_load(int argc, char **argv, const char *buf, off_t len,
 		command_line = strdup("\0");
 		command_line_len = 1;
 	}
+
+	if (info->file_mode) {
+		/* The kernel does the rest */
+		if (ramdisk)
+			info->initrd_fd = open_initrd(ramdisk);
+		info->command_line = command_line;
+		info->command_line_len = command_line_len;
+		return 0;
+	}
+
 	ramdisk_buf = 0;
 	if (ramdisk)
-		ramdisk_buf = slurp_file(ramdisk, &ramdisk_length);
+		ramdisk_buf = slurp_initrd(ramdisk, &ramdisk_length);
 
 	if (entry_16bit || entry_32bit)
 		result = do_bzImage_load(info, buf, len, command_line,
@@ -155,6 +155,7 @@ int elf_x86_64_load(int argc, char **argv, const char *buf, off_t len,
 			break;
 		}
 	}
+	ramdisk = initrd_path(ramdisk);
 	command_line = concat_cmdline(tmp_cmdline, append);
 	if (tmp_cmdline)
 		free(tmp_cmdline);
@@ -232,7 +233,7 @@ int elf_x86_64_load(int argc, char **argv, const char *buf, off_t len,
 		ramdisk_buf = 0;
 		ramdisk_length = 0;
 		if (ramdisk) {
-			ramdisk_buf = slurp_file(ramdisk, &ramdisk_length);
+			ramdisk_buf = slurp_initrd(ramdisk, &ramdisk_length);
 		}
 
 		/* If panic kernel is being loaded, additional segments need
@@ -33,12 +33,16 @@
 #include <arch/options.h>
 
 struct file_type file_type[] = {
-	{ "elf-x86_64", elf_x86_64_probe, elf_x86_64_load, elf_x86_64_usage },
+	{ "elf-x86_64", elf_x86_64_probe, elf_x86_64_load, elf_x86_64_usage,
+	  KERNEL_MAGIC_ELF },
 	{ "multiboot-x86", multiboot_x86_probe, multiboot_x86_load,
-	  multiboot_x86_usage },
-	{ "elf-x86", elf_x86_probe, elf_x86_load, elf_x86_usage },
-	{ "bzImage64", bzImage64_probe, bzImage64_load, bzImage64_usage },
-	{ "bzImage", bzImage_probe, bzImage_load, bzImage_usage },
+	  multiboot_x86_usage, KERNEL_MAGIC_ELF | KERNEL_MAGIC_MULTIBOOT },
+	{ "elf-x86", elf_x86_probe, elf_x86_load, elf_x86_usage,
+	  KERNEL_MAGIC_ELF },
+	{ "bzImage64", bzImage64_probe, bzImage64_load, bzImage64_usage,
+	  KERNEL_MAGIC_BZIMAGE, FILE_TYPE_FILE_LOAD },
+	{ "bzImage", bzImage_probe, bzImage_load, bzImage_usage,
+	  KERNEL_MAGIC_BZIMAGE },
 	{ "beoboot-x86", beoboot_probe, beoboot_load, beoboot_usage },
 	{ "nbi-x86", nbi_probe, nbi_load, nbi_usage },
 };
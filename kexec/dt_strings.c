@@ -0,0 +1,110 @@
+/*
+ * dt_strings: property name table for flattened device-tree builders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "kexec.h"
+#include "dt_strings.h"
+
+#define DT_STRINGS_INIT_SIZE	16384	/* initial bytes for names */
+#define DT_STRINGS_INIT_HASH	1024	/* initial number of hash slots */
+
+static unsigned dt_strings_hashfn(const char *name)
+{
+	unsigned h = 2166136261u;	/* FNV-1a */
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void dt_strings_rehash(struct dt_strings *tab, unsigned hash_size)
+{
+	unsigned *hash;
+	unsigned i, slot, offset;
+
+	hash = xmalloc(hash_size * sizeof(*hash));
+	memset(hash, 0, hash_size * sizeof(*hash));
+
+	for (i = 0; i < tab->hash_size; i++) {
+		if (!tab->hash[i])
+			continue;
+		offset = tab->hash[i] - 1;
+		slot = dt_strings_hashfn(tab->buf + offset) & (hash_size - 1);
+		while (hash[slot])
+			slot = (slot + 1) & (hash_size - 1);
+		hash[slot] = tab->hash[i];
+	}
+
+	free(tab->hash);
+	tab->hash = hash;
+	tab->hash_size = hash_size;
+}
+
+/*
+ * Return the offset of name in the strings block, adding it if needed.
+ * The block is kept NUL padded up to a 4 byte boundary past its end so
+ * callers can copy out _ALIGN(size, 4) bytes.
+ */
+unsigned dt_strings_add(struct dt_strings *tab, const char *name)
+{
+	unsigned slot, offset, len, need;
+
+	if (!tab->hash)
+		dt_strings_rehash(tab, DT_STRINGS_INIT_HASH);
+
+	slot = dt_strings_hashfn(name) & (tab->hash_size - 1);
+	while (tab->hash[slot]) {
+		offset = tab->hash[slot] - 1;
+		if (!strcmp(tab->buf + offset, name))
+			return offset;
+		slot = (slot + 1) & (tab->hash_size - 1);
+	}
+
+	len = strlen(name) + 1;
+	need = _ALIGN(tab->size + len, 4);
+	if (need > tab->alloc) {
+		unsigned alloc = tab->alloc ? tab->alloc : DT_STRINGS_INIT_SIZE;
+
+		while (alloc < need)
+			alloc *= 2;
+		tab->buf = xrealloc(tab->buf, alloc);
+		memset(tab->buf + tab->alloc, 0, alloc - tab->alloc);
+		tab->alloc = alloc;
+	}
+
+	offset = tab->size;
+	memcpy(tab->buf + offset, name, len);
+	tab->size += len;
+	tab->hash[slot] = offset + 1;
+	tab->count++;
+
+	/* Keep the load factor at or below one half */
+	if (tab->count * 2 > tab->hash_size)
+		dt_strings_rehash(tab, tab->hash_size * 2);
+
+	return offset;
+}
+
+void dt_strings_free(struct dt_strings *tab)
+{
+	free(tab->buf);
+	free(tab->hash);
+	memset(tab, 0, sizeof(*tab));
+}
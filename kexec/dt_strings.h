@@ -0,0 +1,21 @@
+#ifndef DT_STRINGS_H
+#define DT_STRINGS_H
+
+/*
+ * Growable, hashed strings block for building a flattened device tree.
+ * Names are stored back to back with their terminating NUL exactly as
+ * they appear in the dt_strings block, so buf can be copied out as is.
+ */
+struct dt_strings {
+	char *buf;		/* the strings block */
+	unsigned size;		/* bytes used in buf */
+	unsigned alloc;		/* bytes allocated for buf */
+	unsigned *hash;		/* open addressed, offset + 1, 0 is empty */
+	unsigned hash_size;	/* number of hash slots, a power of two */
+	unsigned count;		/* number of names stored */
+};
+
+unsigned dt_strings_add(struct dt_strings *tab, const char *name);
+void dt_strings_free(struct dt_strings *tab);
+
+#endif /* DT_STRINGS_H */
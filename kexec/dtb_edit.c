@@ -0,0 +1,129 @@
+/*
+ * dtb_edit: batched in place editing of a flattened device tree
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libfdt.h>
+#include "kexec.h"
+#include "dtb_edit.h"
+
+#define DTB_EDIT_GRANULARITY	1024
+
+/*
+ * Make room for room more bytes of nodes and properties, on top of any
+ * free space the blob has already.
+ */
+void dtb_edit_grow(struct dtb_edit *ed, int room)
+{
+	int size, rc;
+
+	size = _ALIGN_UP(fdt_totalsize(ed->buf) + room, DTB_EDIT_GRANULARITY);
+	if (size > ed->size) {
+		ed->buf = xrealloc(ed->buf, size);
+		ed->size = size;
+	}
+	rc = fdt_open_into(ed->buf, ed->buf, ed->size);
+	if (rc != 0)
+		die("Couldn't expand fdt into new buffer: %s\n",
+		    fdt_strerror(rc));
+}
+
+/*
+ * Start editing blob, which must be a valid device tree in memory from
+ * malloc().  The session takes it over and makes room up front for the
+ * edits to come, e.g. the sum of fdt_prop_len() and fdt_node_len() for
+ * what is about to be added.
+ */
+void dtb_edit_open(struct dtb_edit *ed, char *blob, int room)
+{
+	ed->buf = blob;
+	ed->size = fdt_totalsize(blob);
+	dtb_edit_grow(ed, room);
+}
+
+/* Return the offset of the node at path, adding it if it is missing */
+int dtb_edit_node(struct dtb_edit *ed, const char *path)
+{
+	const char *name;
+	char *parent_path;
+	int off, parent;
+
+	off = fdt_path_offset(ed->buf, path);
+	if (off != -FDT_ERR_NOTFOUND)
+		return off;
+
+	name = strrchr(path, '/');
+	if (!name || !name[1])
+		return off;
+	if (name == path)
+		parent = 0;
+	else {
+		parent_path = xmalloc(name - path + 1);
+		memcpy(parent_path, path, name - path);
+		parent_path[name - path] = '\0';
+		parent = dtb_edit_node(ed, parent_path);
+		free(parent_path);
+		if (parent < 0)
+			return parent;
+	}
+	name++;
+
+	off = fdt_add_subnode(ed->buf, parent, name);
+	if (off == -FDT_ERR_NOSPACE) {
+		dtb_edit_grow(ed, fdt_node_len(name));
+		off = fdt_add_subnode(ed->buf, parent, name);
+	}
+	return off;
+}
+
+/* Set property name of the node at path, adding the node if need be */
+int dtb_edit_setprop(struct dtb_edit *ed, const char *path,
+		     const char *name, const void *val, int len)
+{
+	int off, rc;
+
+	off = dtb_edit_node(ed, path);
+	if (off < 0) {
+		fprintf(stderr, "FDT: Error adding %s node: %s\n", path,
+			fdt_strerror(off));
+		return -1;
+	}
+	rc = fdt_setprop(ed->buf, off, name, val, len);
+	if (rc == -FDT_ERR_NOSPACE) {
+		dtb_edit_grow(ed, fdt_prop_len(name, len));
+		rc = fdt_setprop(ed->buf, off, name, val, len);
+	}
+	if (rc != 0) {
+		fprintf(stderr, "FDT: Error setting %s/%s property: %s\n",
+			path, name, fdt_strerror(rc));
+		return -1;
+	}
+	return 0;
+}
+
+/* Pack the edited blob and hand it back to the caller */
+char *dtb_edit_close(struct dtb_edit *ed, off_t *size)
+{
+	int rc;
+
+	rc = fdt_pack(ed->buf);
+	if (rc != 0)
+		die("Couldn't pack flat tree: %s\n", fdt_strerror(rc));
+	if (size)
+		*size = fdt_totalsize(ed->buf);
+	return ed->buf;
+}
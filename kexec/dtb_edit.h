@@ -0,0 +1,24 @@
+#ifndef DTB_EDIT_H
+#define DTB_EDIT_H
+
+#include <sys/types.h>
+
+/*
+ * An edit session on a flattened device tree.  The blob is opened once
+ * with room for all the edits to come, changed in place with libfdt and
+ * packed once at the end.  It is only grown again if the room asked for
+ * up front runs out.
+ */
+struct dtb_edit {
+	char *buf;	/* the blob, owned by the session */
+	int size;	/* bytes allocated for buf */
+};
+
+void dtb_edit_open(struct dtb_edit *ed, char *blob, int room);
+void dtb_edit_grow(struct dtb_edit *ed, int room);
+int dtb_edit_node(struct dtb_edit *ed, const char *path);
+int dtb_edit_setprop(struct dtb_edit *ed, const char *path,
+		     const char *name, const void *val, int len);
+char *dtb_edit_close(struct dtb_edit *ed, off_t *size);
+
+#endif /* DTB_EDIT_H */
@@ -30,17 +30,20 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <libfdt.h>
 #include "kexec.h"
 #include "fs2dt.h"
+#include "firmware_memmap.h"
+#include "dt_strings.h"
+#include "fw_cache.h"
 
 #define MAXPATH 1024		/* max path name length */
-#define NAMESPACE 16384		/* max bytes for property names */
 #define INIT_TREE_WORDS 65536	/* Initial num words for prop values */
 #define MEMRESERVE 256		/* max number of reserved memory blocks */
 #define MEM_RANGE_CHUNK_SZ 2048 /* Initial num dwords for mem ranges */
 
 static char pathname[MAXPATH], *pathstart;
-static char propnames[NAMESPACE] = { 0 };
+static struct dt_strings propnames;
 static unsigned *dt_base, *dt;
 static unsigned int dt_cur_size;
 static unsigned long long mem_rsrv[2*MEMRESERVE] = { 0ULL, 0ULL };
@@ -64,11 +67,12 @@ static void pad_structure_block(size_t len) {
 
 /* Before we add something to the dt, reserve N words using this.
  * If there isn't enough room, it's realloced -- and you don't overflow and
- * splat bits of your heap.
+ * splat bits of your heap.  The buffer grows geometrically so that large
+ * trees don't pay for a realloc and copy every INIT_TREE_WORDS words.
  */
 static void dt_reserve(unsigned **dt_ptr, unsigned words)
 {
-	unsigned int sz = INIT_TREE_WORDS;
+	unsigned int sz = dt_cur_size;
 
 	if (sz < words)
 		sz = words;
@@ -143,48 +147,302 @@ static void checkprop(char *name, unsigned *data, int len)
 
 /*
  * return the property index for a property name, creating a new one
- * if needed.
+ * if needed.  Names are hashed, so this stays cheap on trees with many
+ * thousands of properties.
  */
 static unsigned propnum(const char *name)
 {
-	unsigned offset = 0;
+	return dt_strings_add(&propnames, name);
+}
 
-	while(propnames[offset])
-		if (strcmp(name, propnames+offset))
-			offset += strlen(propnames+offset)+1;
-		else
-			return offset;
+/* append a property with the given value to the structure block */
+static void dt_add_prop(const char *name, const void *data, size_t len)
+{
+	dt_reserve(&dt, 4+((len + 3)/4));
+	*dt++ = cpu_to_be32(3);
+	*dt++ = cpu_to_be32(len);
+	*dt++ = cpu_to_be32(propnum(name));
+	pad_structure_block(len);
+	memcpy(dt, data, len);
+	dt += (len + 3)/4;
+}
+
+/*
+ * With --fw-cache the properties read from /proc/device-tree are kept
+ * between loads, one record per node under its path.  sysfs gives a
+ * property file a new inode when its value changes, so the name, inode,
+ * size and mtime of every file in a node make a signature that tells
+ * whether the node's record is still good.  Only the nodes that changed,
+ * e.g. after cpu or memory hotplug, are read from the files again.
+ */
+#define DT_CACHE_NAME	"device-tree"
+
+struct dt_cache_node {
+	uint64_t sig;
+	uint32_t size;		/* whole record, a multiple of 8 */
+	uint32_t path_len;	/* including the '\0' */
+	/* path, then struct dt_cache_prop entries, each 4 byte aligned */
+};
+
+struct dt_cache_prop {
+	uint32_t name_len;	/* including the '\0' */
+	uint32_t len;
+	/* name, then value */
+};
+
+static int dt_cache_on;
+static const struct dt_cache_node **dt_cache_slot;
+static unsigned int dt_cache_mask;
+static char *dt_cache_buf;
+static size_t dt_cache_size, dt_cache_alloc, dt_cache_cur;
+static int dt_cache_hits, dt_cache_nodes;
+
+static uint64_t dt_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t dt_path_hash(const char *path)
+{
+	return dt_hash(0xcbf29ce484222325ULL, path, strlen(path));
+}
+
+/* Signature of a node's property files, 0 if it can't be taken */
+static uint64_t dt_node_sig(int dfd, struct dirent **nlist, int numlist)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	struct stat st;
+	uint64_t v[5];
+	int i;
+
+	for (i = 0; i < numlist; i++) {
+		const char *name = nlist[i]->d_name;
+
+		if (nlist[i]->d_type == DT_DIR || !strcmp(name, ".") ||
+		    !strcmp(name, ".."))
+			continue;
+		if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW))
+			return 0;
+		if (S_ISDIR(st.st_mode))
+			continue;
+		v[0] = st.st_ino;
+		v[1] = st.st_size;
+		v[2] = st.st_mode;
+		v[3] = st.st_mtim.tv_sec;
+		v[4] = st.st_mtim.tv_nsec;
+		hash = dt_hash(hash, name, strlen(name) + 1);
+		hash = dt_hash(hash, v, sizeof(v));
+	}
+	return hash ? hash : 1;
+}
 
-	if (NAMESPACE - offset < strlen(name) + 1)
-		die("unrecoverable error: propnames overrun\n");
+static const struct dt_cache_prop *dt_cache_next(const struct dt_cache_prop *cp)
+{
+	return (const void *)((const char *)(cp + 1) +
+			      _ALIGN(cp->name_len + cp->len, 4));
+}
 
-	strcpy(propnames+offset, name);
+static const struct dt_cache_prop *dt_cache_first(const struct dt_cache_node *cn)
+{
+	return (const void *)((const char *)(cn + 1) +
+			      _ALIGN(cn->path_len, 4));
+}
 
-	return offset;
+/* Check a record read back from the cache file, return its size or 0 */
+static size_t dt_cache_check(const char *p, size_t left)
+{
+	const struct dt_cache_node *cn = (const void *)p;
+	const struct dt_cache_prop *cp;
+	const char *end;
+
+	if (left < sizeof(*cn) || cn->size > left || cn->size % 8 ||
+	    cn->size < sizeof(*cn) + _ALIGN(cn->path_len, 4) ||
+	    !cn->path_len || p[sizeof(*cn) + cn->path_len - 1])
+		return 0;
+	end = p + cn->size;
+	for (cp = dt_cache_first(cn); (const char *)cp + sizeof(*cp) <= end;
+	     cp = dt_cache_next(cp)) {
+		if (!cp->name_len || cp->name_len > (size_t)(end - (char *)cp) ||
+		    cp->len > (size_t)(end - (char *)cp) ||
+		    sizeof(*cp) + _ALIGN(cp->name_len + cp->len, 4) >
+		    (size_t)(end - (char *)cp) ||
+		    ((const char *)(cp + 1))[cp->name_len - 1])
+			return 0;
+	}
+	return cn->size;
+}
+
+/* Index the records saved by the last load by their path */
+static void dt_cache_load(void)
+{
+	const char *data, *p;
+	size_t size, len;
+	unsigned int n = 0, i;
+
+	dt_cache_on = fw_cache_enabled();
+	if (!dt_cache_on)
+		return;
+	data = fw_cache_get(DT_CACHE_NAME, &size);
+	if (!data)
+		return;
+	for (p = data; p < data + size; p += len) {
+		len = dt_cache_check(p, data + size - p);
+		if (!len)
+			return;
+		n++;
+	}
+
+	for (dt_cache_mask = 1; dt_cache_mask < 2 * n; dt_cache_mask <<= 1)
+		;
+	dt_cache_slot = xmalloc(dt_cache_mask * sizeof(*dt_cache_slot));
+	memset(dt_cache_slot, 0, dt_cache_mask * sizeof(*dt_cache_slot));
+	dt_cache_mask--;
+	for (p = data; p < data + size; p += len) {
+		const struct dt_cache_node *cn = (const void *)p;
+
+		len = cn->size;
+		i = dt_path_hash((const char *)(cn + 1)) & dt_cache_mask;
+		while (dt_cache_slot[i])
+			i = (i + 1) & dt_cache_mask;
+		dt_cache_slot[i] = cn;
+	}
+}
+
+static const struct dt_cache_node *dt_cache_lookup(const char *path,
+						   uint64_t sig)
+{
+	const struct dt_cache_node *cn;
+	unsigned int i;
+
+	if (!dt_cache_slot || !sig)
+		return NULL;
+	i = dt_path_hash(path) & dt_cache_mask;
+	for (; (cn = dt_cache_slot[i]) != NULL; i = (i + 1) & dt_cache_mask) {
+		if (!strcmp((const char *)(cn + 1), path))
+			return cn->sig == sig ? cn : NULL;
+	}
+	return NULL;
+}
+
+/* Find a property in a cached node, NULL if it wasn't read last time */
+static const void *dt_cache_prop(const struct dt_cache_node *cn,
+				 const char *name, size_t *len)
+{
+	const struct dt_cache_prop *cp;
+	const char *end = (const char *)cn + cn->size;
+
+	for (cp = dt_cache_first(cn); (const char *)cp + sizeof(*cp) <= end;
+	     cp = dt_cache_next(cp)) {
+		if (!strcmp((const char *)(cp + 1), name)) {
+			*len = cp->len;
+			return (const char *)(cp + 1) + cp->name_len;
+		}
+	}
+	return NULL;
+}
+
+static void *dt_cache_append(size_t len)
+{
+	void *p;
+
+	if (dt_cache_size + len > dt_cache_alloc) {
+		dt_cache_alloc = dt_cache_alloc ? dt_cache_alloc * 2 : 65536;
+		if (dt_cache_alloc < dt_cache_size + len)
+			dt_cache_alloc = dt_cache_size + len;
+		dt_cache_buf = xrealloc(dt_cache_buf, dt_cache_alloc);
+	}
+	p = dt_cache_buf + dt_cache_size;
+	memset(p, 0, len);
+	dt_cache_size += len;
+	return p;
+}
+
+/* Start the new record for a node, the next load finds it under path */
+static void dt_cache_begin(const char *path, uint64_t sig)
+{
+	struct dt_cache_node *cn;
+	size_t plen = strlen(path) + 1;
+
+	dt_cache_cur = dt_cache_size;
+	cn = dt_cache_append(sizeof(*cn) + _ALIGN(plen, 4));
+	cn->sig = sig;
+	cn->path_len = plen;
+	memcpy(cn + 1, path, plen);
+}
+
+static void dt_cache_add(const char *name, const void *data, size_t len)
+{
+	struct dt_cache_prop *cp;
+	size_t nlen = strlen(name) + 1;
+
+	cp = dt_cache_append(sizeof(*cp) + _ALIGN(nlen + len, 4));
+	cp->name_len = nlen;
+	cp->len = len;
+	memcpy(cp + 1, name, nlen);
+	memcpy((char *)(cp + 1) + nlen, data, len);
+}
+
+static void dt_cache_end(void)
+{
+	struct dt_cache_node *cn;
+
+	dt_cache_append(_ALIGN(dt_cache_size, 8) - dt_cache_size);
+	cn = (void *)(dt_cache_buf + dt_cache_cur);
+	cn->size = dt_cache_size - dt_cache_cur;
+}
+
+static void dt_cache_save(void)
+{
+	if (!dt_cache_on)
+		return;
+	dbgprintf("device-tree: %d of %d nodes taken from the cache\n",
+		  dt_cache_hits, dt_cache_nodes);
+	fw_cache_put_flags(DT_CACHE_NAME, dt_cache_buf, dt_cache_size,
+			   FW_CACHE_BOOT);
+	free(dt_cache_slot);
+	free(dt_cache_buf);
+	dt_cache_slot = NULL;
+	dt_cache_buf = NULL;
+	dt_cache_size = dt_cache_alloc = 0;
+	dt_cache_hits = dt_cache_nodes = 0;
 }
 
 #ifdef HAVE_DYNAMIC_MEMORY
-static void add_dyn_reconf_usable_mem_property__(int fd)
+/*
+ * Build the linux,drconf-usable-memory value for an ibm,dynamic-memory
+ * property: a 32 bit LMB count followed by one 24 byte entry per LMB.
+ * The property is walked in place rather than with a read() per LMB.
+ * Returns the length in bytes of the array stored in *rangesp.
+ */
+static int drconf_usable_mem_ranges(const void *prop, size_t len,
+				    uint64_t **rangesp)
 {
-	char fname[MAXPATH], *bname;
-	uint64_t buf[32];
+	const char *lmb;
+	struct memory_range *rgns;
 	uint64_t *ranges;
 	int ranges_size = MEM_RANGE_CHUNK_SZ;
 	uint64_t base, end, loc_base, loc_end;
-	size_t i, rngs_cnt, range;
+	size_t i, rngs_cnt, range, first;
 	int rlen = 0;
 	int tmp_indx;
 
-	strcpy(fname, pathname);
-	bname = strrchr(fname, '/');
-	bname[0] = '\0';
-	bname = strrchr(fname, '/');
-	if (strncmp(bname, "/ibm,dynamic-reconfiguration-memory", 36))
-		return;
+	if (len < 4 + (size_t)num_of_lmbs * 24)
+		die("unrecoverable error: short ibm,dynamic-memory property "
+		    "in \"%s\"\n", pathname);
+	lmb = (const char *)prop + 4;
 
-	if (lseek(fd, 4, SEEK_SET) < 0)
-		die("unrecoverable error: error seeking in \"%s\": %s\n",
-			pathname, strerror(errno));
+	/* Sort a copy of the usable ranges so every LMB can be intersected
+	 * with a forward sweep instead of a scan of the whole list.
+	 */
+	rgns = xmalloc(usablemem_rgns.size * sizeof(*rgns));
+	memcpy(rgns, usablemem_rgns.ranges, usablemem_rgns.size * sizeof(*rgns));
+	qsort(rgns, usablemem_rgns.size, sizeof(*rgns), compare_ranges);
 
 	ranges = malloc(ranges_size*8);
 	if (!ranges)
@@ -192,23 +450,34 @@ static void add_dyn_reconf_usable_mem_property__(int fd)
 		    ranges_size*8);
 
 	rlen = 0;
-	for (i = 0; i < num_of_lmbs; i++) {
-		if (read(fd, buf, 24) < 0)
-			die("unrecoverable error: error reading \"%s\": %s\n",
-				pathname, strerror(errno));
+	base = 0;
+	first = 0;
+	for (i = 0; i < num_of_lmbs; i++, lmb += 24) {
+		uint64_t prev_base = base;
 
-		base = be64_to_cpu((uint64_t) buf[0]);
+		memcpy(&base, lmb, sizeof(base));
+		base = be64_to_cpu(base);
 		end = base + lmb_size;
 		if (~0ULL - base < end)
 			die("unrecoverable error: mem property overflow\n");
 
+		/* LMBs are normally in ascending order; restart the sweep
+		 * if this one isn't.
+		 */
+		if (i && base < prev_base)
+			first = 0;
+		while (first < usablemem_rgns.size && rgns[first].end <= base)
+			first++;
+
 		tmp_indx = rlen++;
 
 		rngs_cnt = 0;
-		for (range = 0; range < usablemem_rgns.size; range++) {
+		for (range = first; range < usablemem_rgns.size; range++) {
 			int add = 0;
-			loc_base = usablemem_rgns.ranges[range].start;
-			loc_end = usablemem_rgns.ranges[range].end;
+			loc_base = rgns[range].start;
+			loc_end = rgns[range].end;
+			if (loc_base >= end)
+				break;
 			if (loc_base >= base && loc_end <= end) {
 				add = 1;
 			} else if (base < loc_end && end > loc_base) {
@@ -221,7 +490,7 @@ static void add_dyn_reconf_usable_mem_property__(int fd)
 
 			if (add) {
 				if (rlen >= (ranges_size-2)) {
-					ranges_size += MEM_RANGE_CHUNK_SZ;
+					ranges_size *= 2;
 					ranges = realloc(ranges, ranges_size*8);
 					if (!ranges)
 						die("unrecoverable error: can't"
@@ -245,7 +514,7 @@ static void add_dyn_reconf_usable_mem_property__(int fd)
 			 * go on for a while writing zeros now.
 			 */
 			if (rlen >= (ranges_size-1)) {
-				ranges_size += MEM_RANGE_CHUNK_SZ;
+				ranges_size *= 2;
 				ranges = realloc(ranges, ranges_size*8);
 				if (!ranges)
 					die("unrecoverable error: can't"
@@ -258,33 +527,51 @@ static void add_dyn_reconf_usable_mem_property__(int fd)
 			ranges[tmp_indx] = cpu_to_be64((uint64_t) rngs_cnt);
 		}
 	}
-		
-	rlen = rlen * sizeof(uint64_t);
+	free(rgns);
+
+	*rangesp = ranges;
+	return rlen * sizeof(uint64_t);
+}
+
+static void add_dyn_reconf_usable_mem_property__(const unsigned *prop,
+						 size_t len)
+{
+	char fname[MAXPATH], *bname;
+	uint64_t *ranges;
+	int rlen;
+
+	strcpy(fname, pathname);
+	bname = strrchr(fname, '/');
+	bname[0] = '\0';
+	bname = strrchr(fname, '/');
+	if (strncmp(bname, "/ibm,dynamic-reconfiguration-memory", 36))
+		return;
+
+	rlen = drconf_usable_mem_ranges(prop, len, &ranges);
 	/*
 	 * Add linux,drconf-usable-memory property.
 	 */
-	dt_reserve(&dt, 4+((rlen + 3)/4));
-	*dt++ = cpu_to_be32(3);
-	*dt++ = cpu_to_be32(rlen);
-	*dt++ = cpu_to_be32(propnum("linux,drconf-usable-memory"));
-	pad_structure_block(rlen);
-	memcpy(dt, ranges, rlen);
+	dt_add_prop("linux,drconf-usable-memory", ranges, rlen);
 	free(ranges);
-	dt += (rlen + 3)/4;
 }
 
-static void add_dyn_reconf_usable_mem_property(struct dirent *dp, int fd)
+static void add_dyn_reconf_usable_mem_property(struct dirent *dp,
+					       const unsigned *prop, size_t len)
 {
 	if (!strcmp(dp->d_name, "ibm,dynamic-memory") && usablemem_rgns.size)
-		add_dyn_reconf_usable_mem_property__(fd);
+		add_dyn_reconf_usable_mem_property__(prop, len);
 }
 #else
-static void add_dyn_reconf_usable_mem_property(struct dirent *dp, int fd) {}
+static void add_dyn_reconf_usable_mem_property(struct dirent *dp,
+					       const unsigned *prop, size_t len) {}
 #endif
 
-static void add_usable_mem_property(int fd, size_t len)
+/*
+ * Build the linux,usable-memory value for a memory node's reg property.
+ * Returns the length in bytes of the array stored in *rangesp.
+ */
+static int usable_mem_ranges(const void *prop, size_t len, uint64_t **rangesp)
 {
-	char fname[MAXPATH], *bname;
 	uint64_t buf[2];
 	uint64_t *ranges;
 	int ranges_size = MEM_RANGE_CHUNK_SZ;
@@ -292,22 +579,10 @@ static void add_usable_mem_property(int fd, size_t len)
 	size_t range;
 	int rlen = 0;
 
-	strcpy(fname, pathname);
-	bname = strrchr(fname,'/');
-	bname[0] = '\0';
-	bname = strrchr(fname,'/');
-	if (strncmp(bname, "/memory@", 8) && strcmp(bname, "/memory"))
-		return;
-
 	if (len < sizeof(buf))
 		die("unrecoverable error: not enough data for mem property\n");
 
-	if (lseek(fd, 0, SEEK_SET) < 0)
-		die("unrecoverable error: error seeking in \"%s\": %s\n",
-		    pathname, strerror(errno));
-	if (read(fd, buf, sizeof(buf)) != sizeof(buf))
-		die("unrecoverable error: error reading \"%s\": %s\n",
-		    pathname, strerror(errno));
+	memcpy(buf, prop, sizeof(buf));
 
 	base = be64_to_cpu(buf[0]);
 	end = be64_to_cpu(buf[1]);
@@ -358,28 +633,48 @@ static void add_usable_mem_property(int fd, size_t len)
 		ranges[rlen++] = 0;
 	}
 
-	rlen = rlen * sizeof(*ranges);
+	*rangesp = ranges;
+	return rlen * sizeof(*ranges);
+}
+
+static void add_usable_mem_property(const unsigned *prop, size_t len)
+{
+	char fname[MAXPATH], *bname;
+	uint64_t *ranges;
+	int rlen;
+
+	strcpy(fname, pathname);
+	bname = strrchr(fname,'/');
+	bname[0] = '\0';
+	bname = strrchr(fname,'/');
+	if (strncmp(bname, "/memory@", 8) && strcmp(bname, "/memory"))
+		return;
+
+	/* prop points into the structure block, which dt_add_prop() may
+	 * move; the ranges are built from it first.
+	 */
+	rlen = usable_mem_ranges(prop, len, &ranges);
 	/*
 	 * No add linux,usable-memory property.
 	 */
-	dt_reserve(&dt, 4+((rlen + 3)/4));
-	*dt++ = cpu_to_be32(3);
-	*dt++ = cpu_to_be32(rlen);
-	*dt++ = cpu_to_be32(propnum("linux,usable-memory"));
-	pad_structure_block(rlen);
-	memcpy(dt, ranges, rlen);
+	dt_add_prop("linux,usable-memory", ranges, rlen);
 	free(ranges);
-	dt += (rlen + 3)/4;
 }
 
-/* put all properties (files) in the property structure */
-static void putprops(char *fn, struct dirent **nlist, int numlist)
+/*
+ * put all properties (files) in the property structure.  Properties
+ * found in cached, the node's record from the last load, aren't read.
+ */
+static void putprops(int dfd, char *fn, struct dirent **nlist, int numlist,
+		     const struct dt_cache_node *cached)
 {
 	struct dirent *dp;
 	int i = 0, fd;
 	size_t len;
 	ssize_t slen;
 	struct stat statbuf;
+	unsigned *prop;
+	const void *data;
 
 	for (i = 0; i < numlist; i++) {
 		dp = nlist[i];
@@ -394,9 +689,9 @@ static void putprops(char *fn, struct dirent **nlist, int numlist)
 		if (!strcmp(dp->d_name, "name"))
                         continue;
 
-		if (lstat(pathname, &statbuf))
-			die("unrecoverable error: could not stat \"%s\": %s\n",
-			    pathname, strerror(errno));
+		/* Subdirectories are handled by putnode() */
+		if (dp->d_type == DT_DIR)
+			continue;
 
 		if (!crash_param && !strcmp(fn,"linux,crashkernel-base"))
 			continue;
@@ -428,8 +723,33 @@ static void putprops(char *fn, struct dirent **nlist, int numlist)
 		if (!strcmp(dp->d_name, "bootargs"))
 			continue;
 
-		if (! S_ISREG(statbuf.st_mode))
+		if (dp->d_type != DT_REG && dp->d_type != DT_UNKNOWN)
+			continue;
+
+		data = cached ? dt_cache_prop(cached, fn, &len) : NULL;
+		if (data) {
+			dt_add_prop(fn, data, len);
+			prop = dt - (len + 3)/4;
+			goto got_prop;
+		}
+
+		fd = openat(dfd, dp->d_name, O_RDONLY | O_NOFOLLOW);
+		if (fd == -1) {
+			/* Symlinks are skipped like any other non-file */
+			if (errno == ELOOP)
+				continue;
+			die("unrecoverable error: could not open \"%s\": %s\n",
+			    pathname, strerror(errno));
+		}
+
+		if (fstat(fd, &statbuf))
+			die("unrecoverable error: could not stat \"%s\": %s\n",
+			    pathname, strerror(errno));
+
+		if (! S_ISREG(statbuf.st_mode)) {
+			close(fd);
 			continue;
+		}
 
 		len = statbuf.st_size;
 
@@ -439,11 +759,6 @@ static void putprops(char *fn, struct dirent **nlist, int numlist)
 		*dt++ = cpu_to_be32(propnum(fn));
 		pad_structure_block(len);
 
-		fd = open(pathname, O_RDONLY);
-		if (fd == -1)
-			die("unrecoverable error: could not open \"%s\": %s\n",
-			    pathname, strerror(errno));
-
 		slen = read(fd, dt, len);
 		if (slen < 0)
 			die("unrecoverable error: could not read \"%s\": %s\n",
@@ -451,21 +766,49 @@ static void putprops(char *fn, struct dirent **nlist, int numlist)
 		if ((size_t)slen != len)
 			die("unrecoverable error: short read from\"%s\"\n",
 			    pathname);
+		close(fd);
 
-		checkprop(fn, dt, len);
-
+		prop = dt;
 		dt += (len + 3)/4;
+got_prop:
+		checkprop(fn, prop, len);
+		if (dt_cache_on)
+			dt_cache_add(fn, prop, len);
 
 		if (!strcmp(dp->d_name, "reg") && usablemem_rgns.size)
-			add_usable_mem_property(fd, len);
-		add_dyn_reconf_usable_mem_property(dp, fd);
-		close(fd);
+			add_usable_mem_property(prop, len);
+		add_dyn_reconf_usable_mem_property(dp, prop, len);
 	}
 
 	fn[0] = '\0';
 	checkprop(pathname, NULL, 0);
 }
 
+/*
+ * Note whether the new command line asks for a crash kernel and
+ * return whether it already carries a root= parameter.
+ */
+static int local_cmdline_has_root(void)
+{
+	if (!local_cmdline[0])
+		return 0;
+	if (strstr(local_cmdline, "crashkernel="))
+		crash_param = 1;
+	return strstr(local_cmdline, "root=") != NULL;
+}
+
+/* Carry the root= parameter over from the old command line */
+static void add_old_root_param(char *last_cmdline)
+{
+	char *param;
+
+	param = strstr(last_cmdline, "root=");
+	if (param) {
+		strcat(local_cmdline, " ");
+		strcat(local_cmdline, strtok(param, " "));
+	}
+}
+
 /*
  * Compare function used to sort the device-tree directories
  * This function will be passed to scandir.
@@ -491,16 +834,21 @@ static int comparefunc(const struct dirent **dentry1,
 
 /*
  * put a node (directory) in the property structure.  first properties
- * then children.
+ * then children.  dfd is an open descriptor for the node's directory;
+ * all property and child lookups are done relative to it so the kernel
+ * doesn't have to resolve the full /proc/device-tree path every time.
  */
-static void putnode(void)
+static void putnode(int dfd)
 {
 	char *dn;
 	struct dirent *dp;
 	char *basename;
 	struct dirent **namelist;
-	int numlist, i;
+	int numlist, i, cfd;
+	unsigned char d_type;
 	struct stat statbuf;
+	const struct dt_cache_node *cached = NULL;
+	uint64_t sig;
 	int plen;
 
 	numlist = scandir(pathname, &namelist, 0, comparefunc);
@@ -526,33 +874,26 @@ static void putnode(void)
 	strcat(pathname, "/");
 	dn = pathname + strlen(pathname);
 
-	putprops(dn, namelist, numlist);
+	if (dt_cache_on) {
+		sig = dt_node_sig(dfd, namelist, numlist);
+		cached = dt_cache_lookup(pathstart, sig);
+		dt_cache_hits += cached != NULL;
+		dt_cache_nodes++;
+		dt_cache_begin(pathstart, sig);
+	}
+	putprops(dfd, dn, namelist, numlist, cached);
+	if (dt_cache_on)
+		dt_cache_end();
 
 	/* Add initrd entries to the second kernel */
 	if (initrd_base && initrd_size && !strcmp(basename,"chosen/")) {
-		int len = 8;
 		uint64_t bevalue;
 
-		dt_reserve(&dt, 12); /* both props, of 6 words ea. */
-		*dt++ = cpu_to_be32(3);
-		*dt++ = cpu_to_be32(len);
-		*dt++ = cpu_to_be32(propnum("linux,initrd-start"));
-		pad_structure_block(len);
-
 		bevalue = cpu_to_be64(initrd_base);
-		memcpy(dt, &bevalue, len);
-		dt += (len + 3)/4;
-
-		len = 8;
-		*dt++ = cpu_to_be32(3);
-		*dt++ = cpu_to_be32(len);
-		*dt++ = cpu_to_be32(propnum("linux,initrd-end"));
+		dt_add_prop("linux,initrd-start", &bevalue, sizeof(bevalue));
 
 		bevalue = cpu_to_be64(initrd_base + initrd_size);
-		pad_structure_block(len);
-
-		memcpy(dt, &bevalue, len);
-		dt += (len + 3)/4;
+		dt_add_prop("linux,initrd-end", &bevalue, sizeof(bevalue));
 
 		reserve(initrd_base, initrd_size);
 	}
@@ -562,25 +903,15 @@ static void putnode(void)
 	if (!strcmp(basename,"chosen/")) {
 		size_t result;
 		size_t cmd_len = 0;
-		char *param = NULL;
 		char filename[MAXPATH];
 		char *buff;
 		int fd;
 
-		cmd_len = strlen(local_cmdline);
-		if (cmd_len != 0) {
-			param = strstr(local_cmdline, "crashkernel=");
-			if (param)
-				crash_param = 1;
-			/* does the new cmdline have a root= ? ... */
-			param = strstr(local_cmdline, "root=");
-		}
-
-		/* ... if not, grab root= from the old command line */
-		if (!param) {
+		/* does the new cmdline have a root= ? ... */
+		if (!local_cmdline_has_root()) {
+			/* ... if not, grab root= from the old command line */
 			FILE *fp;
 			char *last_cmdline = NULL;
-			char *old_param;
 
 			strcpy(filename, pathname);
 			strcat(filename, "bootargs");
@@ -588,14 +919,8 @@ static void putnode(void)
 			if (fp) {
 				if (getline(&last_cmdline, &cmd_len, fp) == -1)
 					die("unable to read %s\n", filename);
-
-				param = strstr(last_cmdline, "root=");
-				if (param) {
-					old_param = strtok(param, " ");
-					if (cmd_len != 0)
-						strcat(local_cmdline, " ");
-					strcat(local_cmdline, old_param);
-				}
+				add_old_root_param(last_cmdline);
+				fclose(fp);
 			}
 			if (last_cmdline)
 				free(last_cmdline);
@@ -605,13 +930,7 @@ static void putnode(void)
 		cmd_len = cmd_len + 1;
 
 		/* add new bootargs */
-		dt_reserve(&dt, 4+((cmd_len+3)/4));
-		*dt++ = cpu_to_be32(3);
-		*dt++ = cpu_to_be32(cmd_len);
-		*dt++ = cpu_to_be32(propnum("bootargs"));
-		pad_structure_block(cmd_len);
-		memcpy(dt, local_cmdline,cmd_len);
-		dt += (cmd_len + 3)/4;
+		dt_add_prop("bootargs", local_cmdline, cmd_len);
 
 		fprintf(stderr, "Modified cmdline:%s\n", local_cmdline);
 
@@ -679,17 +998,28 @@ no_debug:
 	for (i=0; i < numlist; i++) {
 		dp = namelist[i];
 		strcpy(dn, dp->d_name);
+		d_type = dp->d_type;
 		free(namelist[i]);
 
 		if (!strcmp(dn, ".") || !strcmp(dn, ".."))
 			continue;
 
-		if (lstat(pathname, &statbuf))
-			die("unrecoverable error: could not stat \"%s\": %s\n",
-			    pathname, strerror(errno));
+		if (d_type == DT_UNKNOWN) {
+			if (fstatat(dfd, dn, &statbuf, AT_SYMLINK_NOFOLLOW))
+				die("unrecoverable error: could not stat "
+				    "\"%s\": %s\n", pathname, strerror(errno));
+			if (!S_ISDIR(statbuf.st_mode))
+				continue;
+		} else if (d_type != DT_DIR) {
+			continue;
+		}
 
-		if (S_ISDIR(statbuf.st_mode))
-			putnode();
+		cfd = openat(dfd, dn, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		if (cfd == -1)
+			die("unrecoverable error: could not open \"%s\": %s\n",
+			    pathname, strerror(errno));
+		putnode(cfd);
+		close(cfd);
 	}
 
 	dt_reserve(&dt, 1);
@@ -727,7 +1057,7 @@ static void add_boot_block(char **bufp, off_t *sizep)
 #endif
 	bb->off_dt_strings = cpu_to_be32(be32_to_cpu(bb->off_dt_struct) + len);
 
-	len = propnum("");
+	len = propnames.size;
 	bb->dt_strings_size = cpu_to_be32(len);
 	len = _ALIGN(len, 4);
 	bb->totalsize = cpu_to_be32(be32_to_cpu(bb->off_dt_strings) + len);
@@ -756,7 +1086,7 @@ static void add_boot_block(char **bufp, off_t *sizep)
 
 	toff += be32_to_cpu(bb->off_dt_strings) - be32_to_cpu(bb->off_dt_struct);
 	tlen = be32_to_cpu(bb->totalsize) - be32_to_cpu(bb->off_dt_strings);
-	memcpy(buf + toff, propnames,  tlen);
+	memcpy(buf + toff, propnames.buf,  tlen);
 
 	*sizep = toff + be32_to_cpu(bb->totalsize) -
 		be32_to_cpu(bb->off_dt_strings);
@@ -764,6 +1094,8 @@ static void add_boot_block(char **bufp, off_t *sizep)
 
 void create_flatten_tree(char **bufp, off_t *sizep, const char *cmdline)
 {
+	int dfd;
+
 	strcpy(pathname, "/proc/device-tree/");
 
 	pathstart = pathname + strlen(pathname);
@@ -780,10 +1112,273 @@ void create_flatten_tree(char **bufp, off_t *sizep, const char *cmdline)
 	if (cmdline)
 		strcpy(local_cmdline, cmdline);
 
-	putnode();
+	dfd = open(pathname, O_RDONLY | O_DIRECTORY);
+	if (dfd == -1)
+		die("unrecoverable error: could not open \"%s\": %s\n",
+		    pathname, strerror(errno));
+	dt_cache_load();
+	putnode(dfd);
+	close(dfd);
+	dt_cache_save();
 	dt_reserve(&dt, 1);
 	*dt++ = cpu_to_be32(9);
 
 	add_boot_block(bufp, sizep);
 	free(dt_base);
 }
+
+/*
+ * Grow an FDT being edited in place.  libfdt reports -FDT_ERR_NOSPACE
+ * when an edit doesn't fit; node and property offsets are relative to
+ * the structure block, so they stay valid across the move.
+ */
+static void fdt_grow(char **bufp)
+{
+	int size = fdt_totalsize(*bufp) * 2;
+	char *buf;
+	int ret;
+
+	buf = xmalloc(size);
+	ret = fdt_open_into(*bufp, buf, size);
+	if (ret < 0)
+		die("unrecoverable error: can't expand device tree: %s\n",
+		    fdt_strerror(ret));
+	free(*bufp);
+	*bufp = buf;
+}
+
+static void fdt_setprop_grow(char **bufp, int node, const char *name,
+			     const void *val, int len)
+{
+	int ret;
+
+	while ((ret = fdt_setprop(*bufp, node, name, val, len)) ==
+	       -FDT_ERR_NOSPACE)
+		fdt_grow(bufp);
+	if (ret < 0)
+		die("unrecoverable error: can't set %s: %s\n", name,
+		    fdt_strerror(ret));
+}
+
+static void fdt_delprop_quiet(char *buf, int node, const char *name)
+{
+	int ret;
+
+	ret = fdt_delprop(buf, node, name);
+	if (ret < 0 && ret != -FDT_ERR_NOTFOUND)
+		die("unrecoverable error: can't delete %s: %s\n", name,
+		    fdt_strerror(ret));
+}
+
+/*
+ * Drop the properties putprops() would have skipped, reserve the
+ * rtas/tce/initrd regions checkprop() knows about and add the
+ * linux,usable-memory style properties for a crash kernel.
+ */
+static void fixup_fdt_nodes(char **bufp)
+{
+	const struct fdt_property *fprop;
+	const char *name, *nname;
+	uint64_t *ranges;
+	int node, next, depth = 0, rlen;
+	int offset, nextoffset, len;
+	uint32_t tag;
+
+	for (node = fdt_next_node(*bufp, -1, &depth); node >= 0; node = next) {
+		if (!crash_param) {
+			fdt_delprop_quiet(*bufp, node, "linux,crashkernel-base");
+			fdt_delprop_quiet(*bufp, node, "linux,crashkernel-size");
+		}
+		fdt_delprop_quiet(*bufp, node, "linux,pci-domain");
+		fdt_delprop_quiet(*bufp, node, "linux,htab-base");
+		fdt_delprop_quiet(*bufp, node, "linux,htab-size");
+		fdt_delprop_quiet(*bufp, node, "linux,kernel-end");
+
+		/* Feed this node's properties to checkprop() */
+		offset = node;
+		tag = fdt_next_tag(*bufp, offset, &nextoffset);
+		for (;;) {
+			offset = nextoffset;
+			tag = fdt_next_tag(*bufp, offset, &nextoffset);
+			if (tag == FDT_NOP)
+				continue;
+			if (tag != FDT_PROP)
+				break;
+			fprop = fdt_offset_ptr(*bufp, offset, sizeof(*fprop));
+			if (!fprop)
+				die("unrecoverable error: truncated device tree\n");
+			name = fdt_string(*bufp, be32_to_cpu(fprop->nameoff));
+			len = be32_to_cpu(fprop->len);
+			checkprop((char *)name, (unsigned *)fprop->data, len);
+		}
+		checkprop(pathname, NULL, 0);
+
+		nname = fdt_get_name(*bufp, node, NULL);
+		if (usablemem_rgns.size && nname &&
+		    (!strncmp(nname, "memory@", 7) || !strcmp(nname, "memory"))) {
+			fprop = fdt_get_property(*bufp, node, "reg", &len);
+			if (fprop) {
+				rlen = usable_mem_ranges(fprop->data, len,
+							 &ranges);
+				fdt_setprop_grow(bufp, node,
+						 "linux,usable-memory",
+						 ranges, rlen);
+				free(ranges);
+			}
+		}
+#ifdef HAVE_DYNAMIC_MEMORY
+		if (usablemem_rgns.size && nname &&
+		    !strcmp(nname, "ibm,dynamic-reconfiguration-memory")) {
+			fprop = fdt_get_property(*bufp, node,
+						 "ibm,dynamic-memory", &len);
+			if (fprop) {
+				rlen = drconf_usable_mem_ranges(fprop->data,
+								len, &ranges);
+				fdt_setprop_grow(bufp, node,
+						 "linux,drconf-usable-memory",
+						 ranges, rlen);
+				free(ranges);
+			}
+		}
+#endif
+		next = fdt_next_node(*bufp, node, &depth);
+	}
+}
+
+/*
+ * Fill in /chosen the way putnode() does: bootargs, the new initrd and
+ * whether purgatory may print to an hvterm console.
+ */
+static void fixup_fdt_chosen(char **bufp)
+{
+	const char *prop, *compat;
+	char *last_cmdline;
+	uint64_t bevalue;
+	int node, len;
+
+	node = fdt_path_offset(*bufp, "/chosen");
+	while (node == -FDT_ERR_NOTFOUND) {
+		node = fdt_add_subnode(*bufp, 0, "chosen");
+		if (node == -FDT_ERR_NOSPACE) {
+			fdt_grow(bufp);
+			node = -FDT_ERR_NOTFOUND;
+		}
+	}
+	if (node < 0)
+		die("unrecoverable error: can't find /chosen: %s\n",
+		    fdt_strerror(node));
+
+	if (!reuse_initrd) {
+		fdt_delprop_quiet(*bufp, node, "linux,initrd-start");
+		fdt_delprop_quiet(*bufp, node, "linux,initrd-end");
+	}
+	if (initrd_base && initrd_size) {
+		bevalue = cpu_to_be64(initrd_base);
+		fdt_setprop_grow(bufp, node, "linux,initrd-start",
+				 &bevalue, sizeof(bevalue));
+		bevalue = cpu_to_be64(initrd_base + initrd_size);
+		fdt_setprop_grow(bufp, node, "linux,initrd-end",
+				 &bevalue, sizeof(bevalue));
+		reserve(initrd_base, initrd_size);
+	}
+
+	if (!local_cmdline_has_root()) {
+		prop = fdt_getprop(*bufp, node, "bootargs", &len);
+		if (prop && len > 0) {
+			last_cmdline = xmalloc(len + 1);
+			memcpy(last_cmdline, prop, len);
+			last_cmdline[len] = '\0';
+			add_old_root_param(last_cmdline);
+			free(last_cmdline);
+		}
+	}
+	strcat(local_cmdline, " ");
+	fdt_setprop_grow(bufp, node, "bootargs", local_cmdline,
+			 strlen(local_cmdline) + 1);
+	fprintf(stderr, "Modified cmdline:%s\n", local_cmdline);
+
+	/* See putnode(): only pseries/hvcterminal is supported */
+	prop = fdt_getprop(*bufp, node, "linux,stdout-path", &len);
+	if (!prop || len <= 0 || prop[len - 1] != '\0') {
+		printf("Unable to find linux,stdout-path, printing from "
+		       "purgatory is diabled\n");
+		return;
+	}
+	node = fdt_path_offset(*bufp, prop);
+	compat = node < 0 ? NULL : fdt_getprop(*bufp, node, "compatible",
+					       &len);
+	if (!compat) {
+		printf("Unable to find %s/compatible printing from purgatory "
+		       "is diabled\n", prop);
+		return;
+	}
+	if (!strcmp(compat, "hvterm1") || !strcmp(compat, "hvterm-protocol"))
+		my_debug = 1;
+}
+
+/*
+ * Build the device tree for the new kernel by editing an existing
+ * flattened tree instead of walking /proc/device-tree.  dtb is normally
+ * /sys/firmware/fdt, but any blob describing the running system (e.g.
+ * one saved from an earlier load) will do.  Only the properties
+ * create_flatten_tree() would change are touched and the reserve map
+ * is rebuilt from scratch.
+ */
+void fixup_flatten_tree(const char *dtb, char **bufp, off_t *sizep,
+			const char *cmdline)
+{
+	char *blob, *buf;
+	off_t blob_size;
+	size_t offset;
+	int size, ret;
+
+	blob = slurp_file(dtb, &blob_size);
+	ret = fdt_check_header(blob);
+	if (ret < 0 || blob_size < (off_t)fdt_totalsize(blob))
+		die("unrecoverable error: \"%s\" is not a valid device tree "
+		    "blob\n", dtb);
+
+	size = fdt_totalsize(blob) + INIT_TREE_WORDS * 4;
+	buf = xmalloc(size);
+	ret = fdt_open_into(blob, buf, size);
+	if (ret < 0)
+		die("unrecoverable error: can't open \"%s\": %s\n", dtb,
+		    fdt_strerror(ret));
+	free(blob);
+
+	snprintf(pathname, MAXPATH, "%s", dtb);
+	if (cmdline)
+		strcpy(local_cmdline, cmdline);
+	else
+		local_cmdline[0] = '\0';
+
+	/* crash_param has to be known before crashkernel-* are dropped */
+	local_cmdline_has_root();
+	fixup_fdt_nodes(&buf);
+	fixup_fdt_chosen(&buf);
+
+	while (fdt_num_mem_rsv(buf) > 0)
+		fdt_del_mem_rsv(buf, 0);
+	for (offset = 0; be64_to_cpu(mem_rsrv[offset + 1]); offset += 2) {
+		while ((ret = fdt_add_mem_rsv(buf,
+					be64_to_cpu(mem_rsrv[offset]),
+					be64_to_cpu(mem_rsrv[offset + 1]))) ==
+		       -FDT_ERR_NOSPACE)
+			fdt_grow(&buf);
+		if (ret < 0)
+			die("unrecoverable error: can't add reservation: %s\n",
+			    fdt_strerror(ret));
+	}
+#ifdef NEED_RESERVE_DTB
+	/* patched later in kexec_load */
+	while ((ret = fdt_add_mem_rsv(buf, 0, 1)) == -FDT_ERR_NOSPACE)
+		fdt_grow(&buf);
+	if (ret < 0)
+		die("unrecoverable error: can't add reservation: %s\n",
+		    fdt_strerror(ret));
+#endif
+
+	fdt_pack(buf);
+	*bufp = buf;
+	*sizep = fdt_totalsize(buf);
+}
@@ -34,5 +34,6 @@ int my_debug;
 
 void reserve(unsigned long long where, unsigned long long length);
 void create_flatten_tree(char **, off_t *, const char *);
+void fixup_flatten_tree(const char *, char **, off_t *, const char *);
 
 #endif /* KEXEC_H */
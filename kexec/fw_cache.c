@@ -0,0 +1,295 @@
+/*
+ * fw_cache.c: Cache firmware state between kexec runs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "kexec.h"
+#include "fw_cache.h"
+
+#define BOOT_ID			"/proc/sys/kernel/random/boot_id"
+
+#define FW_CACHE_MAGIC		"KEXECFWC"
+#define FW_CACHE_VERSION	2
+#define FW_CACHE_NAME_LEN	32
+#define FW_CACHE_MAX		16
+
+/*
+ * File layout: the header, then nr_entries of (struct fw_cache_entry,
+ * data padded to 8 bytes).  Everything is in host byte order; the file
+ * never leaves the machine that wrote it.
+ */
+struct fw_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_entries;
+	struct fw_state_key key;
+};
+
+struct fw_cache_entry {
+	char name[FW_CACHE_NAME_LEN];
+	uint32_t flags;
+	uint32_t pad;
+	uint64_t size;
+};
+
+static struct {
+	const char *filename;
+	struct fw_cache_header hdr;
+	int nr;
+	struct {
+		char name[FW_CACHE_NAME_LEN];
+		void *data;
+		size_t size;
+		unsigned flags;
+	} entry[FW_CACHE_MAX];
+	int dirty;
+} fw_cache;
+
+/* FNV-1a over a whole file; 0 if it can't be read */
+static uint64_t hash_file(const char *filename)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	char buf[8192];
+	ssize_t len, i;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < len; i++) {
+			hash ^= (unsigned char)buf[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	close(fd);
+	return len < 0 ? 0 : hash;
+}
+
+/*
+ * Fill in the key identifying the current boot and memory layout.  The
+ * kernel has no memory hotplug generation count, but any hotplug shows
+ * up in /proc/iomem.
+ */
+int fw_state_key(struct fw_state_key *key)
+{
+	ssize_t len;
+	int fd;
+
+	memset(key, 0, sizeof(*key));
+	fd = open(BOOT_ID, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, key->boot_id, sizeof(key->boot_id) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+
+	key->iomem_hash = hash_file(proc_iomem());
+	if (!key->iomem_hash)
+		return -1;
+	return 0;
+}
+
+static void fw_cache_load(void)
+{
+	struct fw_cache_header hdr;
+	struct fw_cache_entry ent;
+	char *buf, *p, *end;
+	off_t size;
+	unsigned int i;
+	int fd, hotplugged;
+
+	fd = open(fw_cache.filename, O_RDONLY);
+	if (fd < 0)
+		return;
+	close(fd);
+
+	buf = slurp_file(fw_cache.filename, &size);
+	end = buf + size;
+	if (size < (off_t)sizeof(hdr))
+		goto stale;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (memcmp(&hdr, &fw_cache.hdr, offsetof(struct fw_cache_header,
+						 nr_entries)) ||
+	    memcmp(hdr.key.boot_id, fw_cache.hdr.key.boot_id,
+		   sizeof(hdr.key.boot_id)) ||
+	    hdr.nr_entries > FW_CACHE_MAX)
+		goto stale;
+	/* After memory hotplug only FW_CACHE_BOOT entries are still good */
+	hotplugged = hdr.key.iomem_hash != fw_cache.hdr.key.iomem_hash;
+
+	p = buf + sizeof(hdr);
+	for (i = 0; i < hdr.nr_entries; i++) {
+		if ((size_t)(end - p) < sizeof(ent))
+			goto stale;
+		memcpy(&ent, p, sizeof(ent));
+		p += sizeof(ent);
+		if (ent.size > (uint64_t)(end - p) ||
+		    ent.name[FW_CACHE_NAME_LEN - 1])
+			goto stale;
+		if (!hotplugged || (ent.flags & FW_CACHE_BOOT))
+			fw_cache_put_flags(ent.name, p, ent.size, ent.flags);
+		p += _ALIGN(ent.size, 8);
+		if (p > end)
+			p = end;
+	}
+	fw_cache.dirty = hotplugged;
+	dbgprintf("Using firmware state cached in %s\n", fw_cache.filename);
+	free(buf);
+	return;
+
+stale:
+	dbgprintf("Ignoring stale firmware state cache %s\n",
+		  fw_cache.filename);
+	while (fw_cache.nr)
+		free(fw_cache.entry[--fw_cache.nr].data);
+	fw_cache.dirty = 1;
+	free(buf);
+}
+
+void fw_cache_open(const char *filename)
+{
+	memset(&fw_cache.hdr, 0, sizeof(fw_cache.hdr));
+	memcpy(fw_cache.hdr.magic, FW_CACHE_MAGIC, sizeof(fw_cache.hdr.magic));
+	fw_cache.hdr.version = FW_CACHE_VERSION;
+	if (fw_state_key(&fw_cache.hdr.key) < 0) {
+		fprintf(stderr, "Can't identify the running system, not "
+			"caching firmware state\n");
+		return;
+	}
+	fw_cache.filename = filename;
+	fw_cache_load();
+}
+
+/* Is there a cache to get entries from and put them in? */
+int fw_cache_enabled(void)
+{
+	return fw_cache.filename != NULL;
+}
+
+/*
+ * Look up a cached entry.  Returns NULL if there is none, in which case
+ * the caller reads the state itself and hands it to fw_cache_put().
+ */
+const void *fw_cache_get(const char *name, size_t *size)
+{
+	int i;
+
+	for (i = 0; i < fw_cache.nr; i++) {
+		if (strcmp(fw_cache.entry[i].name, name))
+			continue;
+		*size = fw_cache.entry[i].size;
+		return fw_cache.entry[i].data;
+	}
+	return NULL;
+}
+
+void fw_cache_put(const char *name, const void *data, size_t size)
+{
+	fw_cache_put_flags(name, data, size, 0);
+}
+
+/* Like fw_cache_put(), flags is 0 or FW_CACHE_BOOT */
+void fw_cache_put_flags(const char *name, const void *data, size_t size,
+			unsigned flags)
+{
+	int i;
+
+	if (!fw_cache.filename)
+		return;
+	if (strlen(name) >= FW_CACHE_NAME_LEN)
+		die("Firmware cache entry name %s is too long\n", name);
+
+	for (i = 0; i < fw_cache.nr; i++)
+		if (!strcmp(fw_cache.entry[i].name, name))
+			break;
+	if (i == FW_CACHE_MAX)
+		return;
+	if (i < fw_cache.nr && fw_cache.entry[i].size == size &&
+	    fw_cache.entry[i].flags == flags &&
+	    !memcmp(fw_cache.entry[i].data, data, size))
+		return;
+	if (i == fw_cache.nr) {
+		strcpy(fw_cache.entry[i].name, name);
+		fw_cache.nr++;
+	} else {
+		free(fw_cache.entry[i].data);
+	}
+	fw_cache.entry[i].data = xmalloc(size ? size : 1);
+	memcpy(fw_cache.entry[i].data, data, size);
+	fw_cache.entry[i].size = size;
+	fw_cache.entry[i].flags = flags;
+	fw_cache.dirty = 1;
+}
+
+/*
+ * Write the cache back if anything changed.  The new file is written
+ * to a temporary file of its own and renamed over the old one, so a
+ * concurrent kexec never sees a partial or mixed cache.  Failing to
+ * save is not fatal.
+ */
+void fw_cache_save(void)
+{
+	static const char pad[8];
+	struct fw_cache_entry ent;
+	char *tmp, *dir, *slash;
+	int fd, i, err = 0;
+
+	if (!fw_cache.filename || !fw_cache.dirty)
+		return;
+
+	dir = xmalloc(strlen(fw_cache.filename) + 1);
+	strcpy(dir, fw_cache.filename);
+	slash = strrchr(dir, '/');
+	if (slash && slash != dir) {
+		*slash = '\0';
+		mkdir(dir, 0700);
+	}
+	free(dir);
+
+	fd = open_tmpfile(fw_cache.filename, &tmp);
+	if (fd < 0) {
+		fprintf(stderr, "Can't create a temporary file for %s: %s\n",
+			fw_cache.filename, strerror(errno));
+		return;
+	}
+
+	fw_cache.hdr.nr_entries = fw_cache.nr;
+	err |= write_all(fd, &fw_cache.hdr, sizeof(fw_cache.hdr));
+	for (i = 0; i < fw_cache.nr; i++) {
+		memset(&ent, 0, sizeof(ent));
+		strcpy(ent.name, fw_cache.entry[i].name);
+		ent.flags = fw_cache.entry[i].flags;
+		ent.size = fw_cache.entry[i].size;
+		err |= write_all(fd, &ent, sizeof(ent));
+		err |= write_all(fd, fw_cache.entry[i].data, ent.size);
+		err |= write_all(fd, pad, _ALIGN(ent.size, 8) - ent.size);
+	}
+
+	if (close_tmpfile(fd, tmp, fw_cache.filename, err) < 0)
+		fprintf(stderr, "Can't write %s: %s\n", fw_cache.filename,
+			strerror(errno));
+	else
+		fw_cache.dirty = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef FW_CACHE_H
+#define FW_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FW_CACHE_FILE	"/var/cache/kexec/fw-state"
+
+/*
+ * A small on-disk cache of firmware state that is expensive to walk in
+ * sysfs or procfs and doesn't change between loads.  Entries are
+ * opaque named blobs.  The cache is only trusted if it was written
+ * during the current boot (boot_id) and /proc/iomem is unchanged since,
+ * which catches memory hotplug.  All calls are no-ops until
+ * fw_cache_open() has been called.
+ */
+/*
+ * Identifies the running boot and its memory layout: state saved under
+ * one key must not be used under another.
+ */
+struct fw_state_key {
+	char boot_id[40];
+	uint64_t iomem_hash;
+};
+
+int fw_state_key(struct fw_state_key *key);
+
+/*
+ * An entry put with FW_CACHE_BOOT only depends on the boot, not the
+ * memory layout, and survives memory hotplug.
+ */
+#define FW_CACHE_BOOT	1
+
+void fw_cache_open(const char *filename);
+int fw_cache_enabled(void);
+const void *fw_cache_get(const char *name, size_t *size);
+void fw_cache_put(const char *name, const void *data, size_t size);
+void fw_cache_put_flags(const char *name, const void *data, size_t size,
+			unsigned flags);
+void fw_cache_save(void);
+
+#endif /* FW_CACHE_H */
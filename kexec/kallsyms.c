@@ -0,0 +1,186 @@
+/*
+ * kallsyms.c: Resolve kernel symbols from /proc/kallsyms
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "kexec.h"
+#include "kallsyms.h"
+
+#define KALLSYMS		"/proc/kallsyms"
+
+/*
+ * /proc/kallsyms can hold several hundred thousand lines once modules
+ * are loaded, so read it in big chunks and parse each line by hand
+ * instead of going through stdio and sscanf.
+ */
+#define KALLSYMS_CHUNK		(64 * 1024)
+
+static int hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Parse one "<addr> <type> <name>[\t[module]]" line and match it against
+ * the outstanding queries.  Returns the number of queries newly resolved.
+ */
+static int kallsyms_parse_line(const char *line, const char *end,
+			       struct kallsyms_query *query,
+			       const size_t *len, int nr_query)
+{
+	unsigned long long addr = 0;
+	const char *p = line, *name;
+	char type;
+	size_t name_len;
+	int i, v, found = 0;
+
+	while (p < end && (v = hexval(*p)) >= 0) {
+		addr = (addr << 4) | v;
+		p++;
+	}
+	if (p == line || p >= end || *p != ' ')
+		return 0;
+	p++;
+	if (p >= end)
+		return 0;
+	type = *p++;
+	if (p >= end || *p != ' ')
+		return 0;
+	name = ++p;
+	while (p < end && *p != ' ' && *p != '\t')
+		p++;
+	name_len = p - name;
+	if (!name_len)
+		return 0;
+
+	for (i = 0; i < nr_query; i++) {
+		if (query[i].found || len[i] != name_len)
+			continue;
+		if (memcmp(query[i].name, name, name_len) != 0)
+			continue;
+		query[i].addr = addr;
+		query[i].type = type;
+		query[i].found = 1;
+		found++;
+	}
+	return found;
+}
+
+/*
+ * Resolve every name in query[] with a single pass over /proc/kallsyms.
+ * Returns the number of symbols found, or -1 if the file can't be read.
+ */
+int kallsyms_lookup(struct kallsyms_query *query, int nr_query)
+{
+	char *buf;
+	size_t *len;
+	size_t fill = 0;
+	ssize_t result;
+	int fd, i, found = 0, skip = 0;
+
+	fd = open(KALLSYMS, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", KALLSYMS,
+			strerror(errno));
+		return -1;
+	}
+
+	len = xmalloc(nr_query * sizeof(*len));
+	for (i = 0; i < nr_query; i++) {
+		len[i] = strlen(query[i].name);
+		query[i].addr = 0;
+		query[i].type = 0;
+		query[i].found = 0;
+	}
+
+	buf = xmalloc(KALLSYMS_CHUNK);
+	while (found < nr_query) {
+		char *line, *eol, *end;
+
+		result = read(fd, buf + fill, KALLSYMS_CHUNK - fill);
+		if (result < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			fprintf(stderr, "Read on %s failed: %s\n", KALLSYMS,
+				strerror(errno));
+			found = -1;
+			break;
+		}
+		end = buf + fill + result;
+		line = buf;
+		if (skip) {
+			/* Drop the rest of an overlong line */
+			line = memchr(buf, '\n', end - buf);
+			if (!line) {
+				fill = 0;
+				if (result == 0)
+					break;
+				continue;
+			}
+			line++;
+			skip = 0;
+		}
+		while (found < nr_query &&
+		       (eol = memchr(line, '\n', end - line)) != NULL) {
+			found += kallsyms_parse_line(line, eol, query, len,
+						     nr_query);
+			line = eol + 1;
+		}
+		if (result == 0) {
+			/* EOF, the last line may lack a newline */
+			if (found < nr_query && line < end)
+				found += kallsyms_parse_line(line, end, query,
+							     len, nr_query);
+			break;
+		}
+		/* Carry the partial last line over to the next chunk */
+		fill = end - line;
+		if (fill == KALLSYMS_CHUNK) {
+			/* Absurdly long line, skip to the next one */
+			fill = 0;
+			skip = 1;
+		} else {
+			memmove(buf, line, fill);
+		}
+	}
+
+	free(buf);
+	free(len);
+	close(fd);
+	return found;
+}
+
+/*
+ * Convenience wrapper for a single symbol.  Returns 0 if not found.
+ */
+unsigned long long kallsyms_lookup_name(const char *name)
+{
+	struct kallsyms_query query = { .name = name };
+
+	if (kallsyms_lookup(&query, 1) != 1)
+		return 0;
+	return query.addr;
+}
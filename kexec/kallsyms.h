@@ -0,0 +1,20 @@
+#ifndef KALLSYMS_H
+#define KALLSYMS_H
+
+/*
+ * One entry of a batched /proc/kallsyms lookup.  The caller fills in
+ * name; kallsyms_lookup() fills in addr, type and found for every
+ * symbol it sees.  Only the first occurrence of a name is reported,
+ * which matches the core kernel symbol ahead of any module copy.
+ */
+struct kallsyms_query {
+	const char *name;
+	unsigned long long addr;
+	char type;
+	int found;
+};
+
+int kallsyms_lookup(struct kallsyms_query *query, int nr_query);
+unsigned long long kallsyms_lookup_name(const char *name);
+
+#endif /* KALLSYMS_H */
@@ -7,68 +7,79 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 
 #include "kexec-dev.h"
 
-int dev_kexec_open() {
-        int fd = open("/dev/kexec", O_RDWR);
-        if (fd < 0)
-                fprintf(stderr, "open /dev/kexec failed!\n");
-        return fd;
+/*
+ * /dev/kexec is opened on first use and kept open for the life of the
+ * process, so an unload, load and check in one run share one open.
+ * O_CLOEXEC keeps it out of shutdown(8).
+ */
+static int dev_kexec_fd = -1;
+
+int dev_kexec_open(void)
+{
+	if (dev_kexec_fd >= 0)
+		return dev_kexec_fd;
+	dev_kexec_fd = open("/dev/kexec", O_RDWR | O_CLOEXEC);
+	if (dev_kexec_fd < 0)
+		fprintf(stderr, "open /dev/kexec failed: %s\n",
+			strerror(errno));
+	return dev_kexec_fd;
 }
 
-static int dev_kexec_ioctl(int fd, int req, void *arg) {
-        int ret = ioctl(fd, req, arg);
-        if (ret < 0) {
-                fprintf(stderr, "ioctl %d failed with code %d: %s\n", req,
-                       ret, strerror(errno));
-                return -errno;
-        }
-        return ret;
+/* Is there a driver to talk to?  Doesn't complain if there isn't. */
+int dev_kexec_present(void)
+{
+	return dev_kexec_fd >= 0 || access("/dev/kexec", F_OK) == 0;
 }
 
-int dev_kexec_load(void *entry, int nr_segments,
-		   struct kexec_segment *segment, unsigned long kexec_flags)
+static int dev_kexec_ioctl(int req, void *arg)
 {
-	int ret = -1;
-	int fd = dev_kexec_open();
-	fprintf(stderr, "dev_kexec_load: open fd=%d\n", fd);
-	if (fd >= 0) {
-		struct kexec_param data = {
-			.entry = entry,
-			.nr_segments = nr_segments,
-			.segment = segment,
-			.kexec_flags = kexec_flags,
-		};
-		ret = dev_kexec_ioctl(fd, KEXEC_IOC_LOAD, &data);
-        	close(fd);
+	int fd, ret;
+
+	fd = dev_kexec_open();
+	if (fd < 0)
+		return -1;
+	ret = ioctl(fd, req, arg);
+	if (ret < 0) {
+		fprintf(stderr, "ioctl %d failed with code %d: %s\n", req,
+			ret, strerror(errno));
+		return -errno;
 	}
 	return ret;
 }
 
-int dev_kexec_reboot(int magic_num)
+/*
+ * The whole segment list goes to the driver in one KEXEC_IOC_LOAD, an
+ * empty one unloads.
+ */
+int dev_kexec_load(void *entry, int nr_segments,
+		   struct kexec_segment *segment, unsigned long kexec_flags)
+{
+	struct kexec_param data = {
+		.entry = entry,
+		.nr_segments = nr_segments,
+		.segment = segment,
+		.kexec_flags = kexec_flags,
+	};
+
+	dbgprintf("dev_kexec_load: %d segments flags 0x%lx\n",
+		  nr_segments, kexec_flags);
+	return dev_kexec_ioctl(KEXEC_IOC_LOAD, &data);
+}
+
+int dev_kexec_reboot(int UNUSED(magic_num))
 {
-	int ret = -1;
-	int fd = dev_kexec_open();
-	fprintf(stderr, "dev_kexec_reboot: open fd=%d\n", fd);
-	if (fd >= 0) {
-		ret = dev_kexec_ioctl(fd, KEXEC_IOC_REBOOT, NULL);
-        	close(fd);
-	}
-	return ret;
+	return dev_kexec_ioctl(KEXEC_IOC_REBOOT, NULL);
 }
 
 int dev_kexec_check_loaded(void)
 {
-	int ret = -1;
-	int fd = dev_kexec_open();
-	fprintf(stderr, "dev_kexec_check_loaded: open fd=%d\n", fd);
-	if (fd >= 0) {
-		ret = dev_kexec_ioctl(fd, KEXEC_IOC_CHECK_LOADED, NULL);
-		close(fd);
-	}
-	return ret;
+	return dev_kexec_ioctl(KEXEC_IOC_CHECK_LOADED, NULL);
 }
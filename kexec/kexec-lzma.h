@@ -4,5 +4,6 @@
 #include <sys/types.h>
 
 char *lzma_decompress_file(const char *filename, off_t *r_size);
+char *lzma_decompress_buf(const char *in, off_t in_size, off_t *r_size);
 
 #endif /* __KEXEC_LZMA_H */
@@ -8,4 +8,17 @@ struct sha256_region {
 
 #define SHA256_REGIONS 16
 
+/*
+ * How purgatory checks the segments before starting the new kernel,
+ * poked into its verify_policy symbol by kexec (--verify).
+ */
+#define VERIFY_SHA256		0	/* sha256 of every byte */
+#define VERIFY_CRC32C		1	/* crc32c, catches corruption only */
+#define VERIFY_SAMPLED		2	/* sha256 of every Nth chunk */
+#define VERIFY_NONE		3
+
+/* VERIFY_SAMPLED hashes VERIFY_CHUNK bytes out of every verify_stride */
+#define VERIFY_CHUNK		4096
+#define VERIFY_STRIDE_DEFAULT	16
+
 #endif /* KEXEC_SHA256_H */
@@ -0,0 +1,195 @@
+/*
+ * kexec-state.c: Save a prepared load and load it later
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kexec.h"
+#include "kexec-syscall.h"
+#include "fw_cache.h"
+#include "kexec-state.h"
+
+#define LOAD_STATE_MAGIC	"KEXECLDS"
+#define LOAD_STATE_VERSION	1
+
+/*
+ * File layout: the header, nr_segments segment descriptors, then the
+ * segment contents, each 8 byte aligned.  Segment contents are saved
+ * after update_purgatory(), so the purgatory digest is part of them.
+ * Host byte order throughout; a state file is only valid on the boot
+ * that wrote it.
+ */
+struct load_state_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_segments;
+	struct fw_state_key key;
+	uint64_t entry;
+	uint64_t kexec_flags;
+	uint64_t mem_min;
+	uint64_t mem_max;
+};
+
+struct load_state_segment {
+	uint64_t mem;
+	uint64_t memsz;
+	uint64_t bufsz;
+	uint64_t offset;	/* of the contents, from the file start */
+};
+
+int write_load_state(const char *filename, struct kexec_info *info)
+{
+	static const char pad[8];
+	struct load_state_header hdr;
+	struct load_state_segment *seg;
+	uint64_t offset;
+	char *tmp;
+	int fd, i, err = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOAD_STATE_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOAD_STATE_VERSION;
+	hdr.nr_segments = info->nr_segments;
+	if (fw_state_key(&hdr.key) < 0) {
+		fprintf(stderr, "Can't identify the running system\n");
+		return -1;
+	}
+	hdr.entry = (unsigned long)info->entry;
+	hdr.kexec_flags = info->kexec_flags;
+	hdr.mem_min = mem_min;
+	hdr.mem_max = mem_max;
+
+	seg = xmalloc(info->nr_segments * sizeof(*seg) + 1);
+	offset = sizeof(hdr) + info->nr_segments * sizeof(*seg);
+	for (i = 0; i < info->nr_segments; i++) {
+		seg[i].mem = (unsigned long)info->segment[i].mem;
+		seg[i].memsz = info->segment[i].memsz;
+		seg[i].bufsz = info->segment[i].buf ?
+			info->segment[i].bufsz : 0;
+		seg[i].offset = offset;
+		offset += _ALIGN(seg[i].bufsz, 8);
+	}
+
+	/*
+	 * Write a temporary file of our own and rename it over the old
+	 * one, so neither a concurrent --prepare or --commit nor a crash
+	 * here leaves a truncated or mixed file.
+	 */
+	fd = open_tmpfile(filename, &tmp);
+	if (fd < 0) {
+		fprintf(stderr, "Can't create a temporary file for %s: %s\n",
+			filename, strerror(errno));
+		free(seg);
+		return -1;
+	}
+	err |= write_all(fd, &hdr, sizeof(hdr));
+	err |= write_all(fd, seg, info->nr_segments * sizeof(*seg));
+	for (i = 0; i < info->nr_segments; i++) {
+		err |= write_all(fd, info->segment[i].buf, seg[i].bufsz);
+		err |= write_all(fd, pad, _ALIGN(seg[i].bufsz, 8) -
+				 seg[i].bufsz);
+	}
+	free(seg);
+
+	if (close_tmpfile(fd, tmp, filename, err) < 0) {
+		fprintf(stderr, "Can't write %s: %s\n", filename,
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Map a state file and fill in info from it.  The segment buffers point
+ * into the mapping, which is kept for the life of the process.
+ */
+int read_load_state(const char *filename, struct kexec_info *info)
+{
+	struct load_state_header hdr;
+	const struct load_state_segment *seg;
+	struct fw_state_key key;
+	struct stat st;
+	char *map;
+	int fd, i;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", filename,
+			strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(hdr)) {
+		fprintf(stderr, "%s is not a kexec state file\n", filename);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Can't map %s: %s\n", filename,
+			strerror(errno));
+		return -1;
+	}
+
+	memcpy(&hdr, map, sizeof(hdr));
+	if (memcmp(hdr.magic, LOAD_STATE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != LOAD_STATE_VERSION ||
+	    hdr.nr_segments > KEXEC_MAX_SEGMENTS ||
+	    sizeof(hdr) + hdr.nr_segments * sizeof(*seg) >
+	    (uint64_t)st.st_size) {
+		fprintf(stderr, "%s is not a kexec state file\n", filename);
+		goto fail;
+	}
+
+	if (fw_state_key(&key) < 0 || memcmp(&key, &hdr.key, sizeof(key))) {
+		fprintf(stderr, "%s was prepared for a different boot or "
+			"memory layout, prepare it again\n", filename);
+		goto fail;
+	}
+
+	seg = (const struct load_state_segment *)(map + sizeof(hdr));
+	info->segment = xmalloc(hdr.nr_segments * sizeof(*info->segment) + 1);
+	info->nr_segments = hdr.nr_segments;
+	for (i = 0; i < info->nr_segments; i++) {
+		if (seg[i].offset > (uint64_t)st.st_size ||
+		    seg[i].bufsz > (uint64_t)st.st_size - seg[i].offset ||
+		    seg[i].bufsz > seg[i].memsz) {
+			fprintf(stderr, "%s is corrupt\n", filename);
+			free(info->segment);
+			goto fail;
+		}
+		info->segment[i].buf = seg[i].bufsz ? map + seg[i].offset :
+			NULL;
+		info->segment[i].bufsz = seg[i].bufsz;
+		info->segment[i].mem = (void *)(unsigned long)seg[i].mem;
+		info->segment[i].memsz = seg[i].memsz;
+	}
+	info->entry = (void *)(unsigned long)hdr.entry;
+	info->kexec_flags = hdr.kexec_flags;
+	mem_min = hdr.mem_min;
+	mem_max = hdr.mem_max;
+	return 0;
+
+fail:
+	munmap(map, st.st_size);
+	return -1;
+}
@@ -0,0 +1,13 @@
+#ifndef KEXEC_STATE_H
+#define KEXEC_STATE_H
+
+#include "kexec.h"
+
+/*
+ * A fully laid out load (segments, entry point and flags) saved by
+ * "kexec --prepare" and loaded later by "kexec --commit".
+ */
+int write_load_state(const char *filename, struct kexec_info *info);
+int read_load_state(const char *filename, struct kexec_info *info);
+
+#endif /* KEXEC_STATE_H */
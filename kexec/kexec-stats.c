@@ -0,0 +1,105 @@
+/*
+ * kexec-stats.c: Time the phases of a load
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "kexec-stats.h"
+
+/* 0, STATS_TEXT or STATS_JSON */
+int kexec_stats = 0;
+
+static const char *stat_name[STAT_NR] = {
+	[STAT_SLURP]		= "slurp",
+	[STAT_DECOMPRESS]	= "decompress",
+	[STAT_MEMORY_RANGES]	= "memory-ranges",
+	[STAT_PROBE]		= "probe",
+	[STAT_ARCH_LOAD]	= "arch-load",
+	[STAT_LOCATE_HOLE]	= "locate-hole",
+	[STAT_PURGATORY]	= "purgatory",
+	[STAT_SYSCALL]		= "syscall",
+};
+
+static struct {
+	unsigned long long usec;
+	unsigned long long bytes;
+	unsigned long calls;
+	unsigned long long started;
+	int depth;
+} stat[STAT_NR];
+
+static unsigned long long stats_begin;
+
+static unsigned long long now_usec(void)
+{
+	struct timespec ts;
+
+	/* Not gettimeofday(), which jumps when NTP steps the clock */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void stats_init(int format)
+{
+	kexec_stats = format;
+	stats_begin = now_usec();
+}
+
+void stats_start(enum kexec_stat s)
+{
+	if (!kexec_stats)
+		return;
+	if (stat[s].depth++ == 0)
+		stat[s].started = now_usec();
+}
+
+void stats_end(enum kexec_stat s, unsigned long long bytes)
+{
+	if (!kexec_stats)
+		return;
+	stat[s].calls++;
+	stat[s].bytes += bytes;
+	if (--stat[s].depth == 0)
+		stat[s].usec += now_usec() - stat[s].started;
+}
+
+void stats_print(FILE *fp)
+{
+	unsigned long long total;
+	int i;
+
+	if (!kexec_stats)
+		return;
+	total = now_usec() - stats_begin;
+
+	if (kexec_stats == STATS_JSON) {
+		/* One line, so it can be picked out of the other output */
+		fprintf(fp, "{\"total_usec\": %llu, \"phases\": {", total);
+		for (i = 0; i < STAT_NR; i++)
+			fprintf(fp, "%s\"%s\": {\"calls\": %lu, "
+				"\"usec\": %llu, \"bytes\": %llu}",
+				i ? ", " : "", stat_name[i], stat[i].calls,
+				stat[i].usec, stat[i].bytes);
+		fprintf(fp, "}}\n");
+		return;
+	}
+
+	fprintf(fp, "%-14s %8s %12s %14s\n", "phase", "calls", "time(ms)",
+		"bytes");
+	for (i = 0; i < STAT_NR; i++)
+		fprintf(fp, "%-14s %8lu %12.3f %14llu\n", stat_name[i],
+			stat[i].calls, stat[i].usec / 1000.0, stat[i].bytes);
+	fprintf(fp, "%-14s %8s %12.3f\n", "total", "", total / 1000.0);
+}
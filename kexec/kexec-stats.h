@@ -0,0 +1,34 @@
+#ifndef KEXEC_STATS_H
+#define KEXEC_STATS_H
+
+#include <stdio.h>
+
+/*
+ * Per-phase wall time, call and byte counters for the load path,
+ * reported by "kexec --stats".  stats_start()/stats_end() pairs may
+ * nest as long as they name different phases; a phase re-entered
+ * while it is already running is only timed by the outermost pair.
+ */
+enum kexec_stat {
+	STAT_SLURP,
+	STAT_DECOMPRESS,
+	STAT_MEMORY_RANGES,
+	STAT_PROBE,
+	STAT_ARCH_LOAD,
+	STAT_LOCATE_HOLE,
+	STAT_PURGATORY,
+	STAT_SYSCALL,
+	STAT_NR
+};
+
+#define STATS_TEXT	1
+#define STATS_JSON	2
+
+extern int kexec_stats;
+
+void stats_init(int format);
+void stats_start(enum kexec_stat stat);
+void stats_end(enum kexec_stat stat, unsigned long long bytes);
+void stats_print(FILE *fp);
+
+#endif /* KEXEC_STATS_H */
@@ -2,6 +2,7 @@
 #define KEXEC_SYSCALL_H
 
 #define __LIBRARY__
+#include <errno.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -61,6 +62,40 @@ static inline long kexec_load(void *entry, unsigned long nr_segments,
 	return (long) syscall(__NR_kexec_load, entry, nr_segments, segments, flags);
 }
 
+#ifndef __NR_kexec_file_load
+#ifdef __x86_64__
+#define __NR_kexec_file_load	320
+#endif
+#ifdef __powerpc__
+#define __NR_kexec_file_load	382
+#endif
+#ifdef __s390__
+#define __NR_kexec_file_load	381
+#endif
+#endif /*ifndef __NR_kexec_file_load*/
+
+/*
+ * kexec_file_load() takes the kernel and initrd as file descriptors and
+ * does the parsing, placement and (if configured) signature checking in
+ * the kernel.  Not every architecture has it.
+ */
+static inline long kexec_file_load(int kernel_fd, int initrd_fd,
+			unsigned long cmdline_len, const char *cmdline,
+			unsigned long flags)
+{
+#ifdef __NR_kexec_file_load
+	return (long) syscall(__NR_kexec_file_load, kernel_fd, initrd_fd,
+			      cmdline_len, cmdline, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+#define KEXEC_FILE_UNLOAD	0x00000001
+#define KEXEC_FILE_ON_CRASH	0x00000002
+#define KEXEC_FILE_NO_INITRAMFS	0x00000004
+
 #define KEXEC_ON_CRASH		0x00000001
 #define KEXEC_PRESERVE_CONTEXT	0x00000002
 #define KEXEC_ARCH_MASK		0xffff0000
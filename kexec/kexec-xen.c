@@ -14,6 +14,79 @@
 
 #include "crashdump.h"
 
+/*
+ * The interface is opened once and kept for the life of the process,
+ * since the hypercall buffers handed out by xen_seg_alloc() belong to
+ * it and must still be valid when xen_kexec_load() runs.
+ */
+static xc_interface *xen_xch;
+
+static xc_interface *xen_interface(void)
+{
+	if (!xen_xch)
+		xen_xch = xc_interface_open(NULL, NULL, 0);
+	return xen_xch;
+}
+
+/*
+ * Buffers from xen_seg_alloc().  xen_seg_array owns them, like the
+ * bounce buffers in xen_kexec_load(); it is never destroyed, so they
+ * stay valid for the life of the process.
+ */
+static xc_hypercall_buffer_array_t *xen_seg_array;
+static struct {
+	void *buf;
+	size_t size;
+} xen_seg_bufs[KEXEC_MAX_SEGMENTS];
+static int xen_seg_nr;
+
+/*
+ * Allocate size bytes of hypercall safe memory for data that will end
+ * up in a segment, e.g. the initrd.  xen_kexec_load() then passes any
+ * segment that lies within such a buffer to Xen as is, instead of
+ * bouncing it through a copy.  Returns NULL if that isn't possible;
+ * the caller should fall back to malloc().
+ */
+void *xen_seg_alloc(size_t size)
+{
+	DECLARE_HYPERCALL_BUFFER(void, buf);
+	xc_interface *xch;
+
+	if (!size || xen_seg_nr == KEXEC_MAX_SEGMENTS)
+		return NULL;
+	xch = xen_interface();
+	if (!xch)
+		return NULL;
+	if (!xen_seg_array)
+		xen_seg_array = xc_hypercall_buffer_array_create(xch,
+							KEXEC_MAX_SEGMENTS);
+	if (!xen_seg_array)
+		return NULL;
+	buf = xc_hypercall_buffer_array_alloc(xch, xen_seg_array, xen_seg_nr,
+					      buf, size);
+	if (!buf)
+		return NULL;
+	xen_seg_bufs[xen_seg_nr].buf = buf;
+	xen_seg_bufs[xen_seg_nr].size = size;
+	xen_seg_nr++;
+	return buf;
+}
+
+/* Is buf..buf+size inside a buffer from xen_seg_alloc()? */
+static int xen_seg_mapped(const void *buf, size_t size)
+{
+	const char *start, *p = buf;
+	int i;
+
+	for (i = 0; i < xen_seg_nr; i++) {
+		start = xen_seg_bufs[i].buf;
+		if (p >= start && size <= xen_seg_bufs[i].size &&
+		    p - start <= xen_seg_bufs[i].size - size)
+			return 1;
+	}
+	return 0;
+}
+
 int xen_kexec_load(struct kexec_info *info)
 {
 	uint32_t nr_segments = info->nr_segments;
@@ -26,7 +99,7 @@ int xen_kexec_load(struct kexec_info *info)
 	int s;
 	int ret = -1;
 
-	xch = xc_interface_open(NULL, NULL, 0);
+	xch = xen_interface();
 	if (!xch)
 		return -1;
 
@@ -41,13 +114,18 @@ int xen_kexec_load(struct kexec_info *info)
 	for (s = 0; s < nr_segments; s++) {
 		DECLARE_HYPERCALL_BUFFER(void, seg_buf);
 
-		seg_buf = xc_hypercall_buffer_array_alloc(xch, array, s,
-							  seg_buf, segments[s].bufsz);
-		if (seg_buf == NULL)
-			goto out;
-		memcpy(seg_buf, segments[s].buf, segments[s].bufsz);
-
-		set_xen_guest_handle(xen_segs[s].buf.h, seg_buf);
+		if (xen_seg_mapped(segments[s].buf, segments[s].bufsz)) {
+			/* Already in hypercall memory, no need to copy */
+			set_xen_guest_handle_raw(xen_segs[s].buf.h,
+						 segments[s].buf);
+		} else {
+			seg_buf = xc_hypercall_buffer_array_alloc(xch, array,
+						s, seg_buf, segments[s].bufsz);
+			if (seg_buf == NULL)
+				goto out;
+			memcpy(seg_buf, segments[s].buf, segments[s].bufsz);
+			set_xen_guest_handle(xen_segs[s].buf.h, seg_buf);
+		}
 		xen_segs[s].buf_size = segments[s].bufsz;
 		xen_segs[s].dest_maddr = (uint64_t)segments[s].mem;
 		xen_segs[s].dest_size = segments[s].memsz;
@@ -80,7 +158,6 @@ int xen_kexec_load(struct kexec_info *info)
 out:
 	xc_hypercall_buffer_array_destroy(xch, array);
 	free(xen_segs);
-	xc_interface_close(xch);
 
 	return ret;
 }
@@ -120,6 +197,11 @@ void xen_kexec_exec(void)
 
 #else /* ! HAVE_LIBXENCTRL */
 
+void *xen_seg_alloc(size_t UNUSED(size))
+{
+	return NULL;
+}
+
 int xen_kexec_load(struct kexec_info *UNUSED(info))
 {
 	return -1;
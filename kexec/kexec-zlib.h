@@ -7,4 +7,5 @@
 #include "config.h"
 
 char *zlib_decompress_file(const char *filename, off_t *r_size);
+char *zlib_decompress_buf(const char *in, off_t in_size, off_t *r_size);
 #endif /* __KEXEC_ZLIB_H */
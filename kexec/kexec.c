@@ -22,6 +22,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -29,6 +30,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/reboot.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #ifndef _O_BINARY
@@ -40,12 +42,20 @@
 #include "config.h"
 
 #include <sha256.h>
+#include <crc32c.h>
+#include <image.h>
+#include <x86/mb_header.h>
+#include "elf.h"
 #include "kexec.h"
 #include "kexec-syscall.h"
 #include "kexec-elf.h"
 #include "kexec-sha256.h"
 #include "kexec-zlib.h"
 #include "kexec-lzma.h"
+#include "fw_cache.h"
+#include "kexec-state.h"
+#include "kexec-stats.h"
+#include "numa.h"
 #include <arch/options.h>
 
 #include "kexec-dev.h"
@@ -54,6 +64,9 @@ unsigned long long mem_min = 0;
 unsigned long long mem_max = ULONG_MAX;
 static unsigned long kexec_flags = 0;
 int kexec_debug = 0;
+static const char *prepare_file;
+static const char *kernel_stream;
+static int use_file_syscall;
 
 void dbgprint_mem_range(const char *prefix, struct memory_range *mr, int nr_mr)
 {
@@ -166,6 +179,17 @@ void print_segments(FILE *f, struct kexec_info *info)
 	}
 }
 
+/* Bytes of segment contents supplied from user space */
+static unsigned long long segments_size(struct kexec_info *info)
+{
+	unsigned long long size = 0;
+	int i;
+
+	for (i = 0; i < info->nr_segments; i++)
+		size += info->segment[i].bufsz;
+	return size;
+}
+
 int sort_segments(struct kexec_info *info)
 {
 	int i, j;
@@ -200,9 +224,10 @@ int sort_segments(struct kexec_info *info)
 	return 0;
 }
 
-unsigned long locate_hole(struct kexec_info *info,
-	unsigned long hole_size, unsigned long hole_align, 
-	unsigned long hole_min, unsigned long hole_max, 
+/* The search behind locate_hole(), ULONG_MAX if there is no hole */
+static unsigned long find_hole(struct kexec_info *info,
+	unsigned long hole_size, unsigned long hole_align,
+	unsigned long hole_min, unsigned long hole_max,
 	int hole_end)
 {
 	int i, j;
@@ -213,6 +238,7 @@ unsigned long locate_hole(struct kexec_info *info,
 	if (hole_end == 0) {
 		die("Invalid hole end argument of 0 specified to locate_hole");
 	}
+	stats_start(STAT_LOCATE_HOLE);
 
 	/* Set an initial invalid value for the hole base */
 	hole_base = ULONG_MAX;
@@ -293,6 +319,19 @@ unsigned long locate_hole(struct kexec_info *info,
 		}
 	}
 	free(mem_range);
+	stats_end(STAT_LOCATE_HOLE, 0);
+	return hole_base;
+}
+
+unsigned long locate_hole(struct kexec_info *info,
+	unsigned long hole_size, unsigned long hole_align,
+	unsigned long hole_min, unsigned long hole_max,
+	int hole_end)
+{
+	unsigned long hole_base;
+
+	hole_base = find_hole(info, hole_size, hole_align, hole_min, hole_max,
+			      hole_end);
 	if (hole_base == ULONG_MAX) {
 		fprintf(stderr, "Could not find a free area of memory of "
 			"0x%lx bytes...\n", hole_size);
@@ -306,6 +345,196 @@ unsigned long locate_hole(struct kexec_info *info,
 	return hole_base;
 }
 
+/* --placement */
+#define PLACEMENT_ANY		0	/* wherever locate_hole() puts it */
+#define PLACEMENT_NODE0		1	/* the first node if there is room */
+#define PLACEMENT_SPREAD	2	/* each buffer on the next node */
+#define PLACEMENT_PIN		3	/* on placement_node */
+
+static int placement = PLACEMENT_ANY;
+static int placement_node;
+static unsigned int placement_next;
+
+/* Parse any, node0, spread or node:N */
+static int parse_placement(const char *arg)
+{
+	char *endptr;
+
+	if (strcmp(arg, "any") == 0)
+		placement = PLACEMENT_ANY;
+	else if (strcmp(arg, "node0") == 0)
+		placement = PLACEMENT_NODE0;
+	else if (strcmp(arg, "spread") == 0)
+		placement = PLACEMENT_SPREAD;
+	else if (strncmp(arg, "node:", 5) == 0) {
+		placement = PLACEMENT_PIN;
+		placement_node = strtol(arg + 5, &endptr, 0);
+		if (endptr == arg + 5 || *endptr || placement_node < 0)
+			return -1;
+	} else
+		return -1;
+	return 0;
+}
+
+/* Look for a hole in one node's memory only */
+static unsigned long find_hole_node(struct kexec_info *info,
+	const struct numa_node *node, unsigned long hole_size,
+	unsigned long hole_align, unsigned long hole_min,
+	unsigned long hole_max, int hole_end)
+{
+	unsigned long long start, end;
+	unsigned long base;
+	int i, k;
+
+	for (k = 0; k < node->nr_ranges; k++) {
+		/* Bottom up for first fit, top down for last fit */
+		i = hole_end > 0 ? k : node->nr_ranges - 1 - k;
+		start = node->range[i].start;
+		end = node->range[i].end;
+		if (start < hole_min)
+			start = hole_min;
+		if (end > hole_max)
+			end = hole_max;
+		if (start > end)
+			continue;
+		base = find_hole(info, hole_size, hole_align, start, end,
+				 hole_end);
+		if (base != ULONG_MAX)
+			return base;
+	}
+	return ULONG_MAX;
+}
+
+/*
+ * locate_hole() under the --placement policy.  Buffers that don't fit
+ * where the policy wants them go wherever locate_hole() puts them.
+ * With quiet set nothing is printed if there is no hole at all.
+ */
+static unsigned long place_hole(struct kexec_info *info,
+	unsigned long hole_size, unsigned long hole_align,
+	unsigned long hole_min, unsigned long hole_max,
+	int hole_end, int quiet)
+{
+	struct numa_node *nodes;
+	unsigned long base = ULONG_MAX;
+	int nr, first = 0, i;
+
+	if (placement == PLACEMENT_ANY)
+		goto anywhere;
+	nr = numa_nodes(&nodes);
+	if (nr <= 0) {
+		fprintf(stderr, "No NUMA node memory information, "
+			"ignoring --placement\n");
+		placement = PLACEMENT_ANY;
+		goto anywhere;
+	}
+
+	if (placement == PLACEMENT_SPREAD)
+		first = placement_next++ % nr;
+	if (placement == PLACEMENT_PIN) {
+		for (first = 0; first < nr; first++)
+			if (nodes[first].id == placement_node)
+				break;
+		if (first == nr)
+			die("NUMA node %d has no memory\n", placement_node);
+		base = find_hole_node(info, &nodes[first], hole_size,
+				      hole_align, hole_min, hole_max, hole_end);
+		if (base == ULONG_MAX && !quiet)
+			fprintf(stderr, "Warning: no room for 0x%lx bytes on "
+				"node %d\n", hole_size, placement_node);
+	} else {
+		for (i = 0; i < nr && base == ULONG_MAX; i++)
+			base = find_hole_node(info, &nodes[(first + i) % nr],
+					      hole_size, hole_align, hole_min,
+					      hole_max, hole_end);
+	}
+	if (base != ULONG_MAX)
+		return base;
+anywhere:
+	if (quiet)
+		return find_hole(info, hole_size, hole_align, hole_min,
+				 hole_max, hole_end);
+	return locate_hole(info, hole_size, hole_align, hole_min, hole_max,
+			   hole_end);
+}
+
+/*
+ * --huge-align: put buffers at least as big as one of these on a
+ * boundary of that size if there is room, largest first, so the new
+ * kernel can map them with huge pages.
+ */
+static int huge_align;
+static const unsigned long huge_align_size[] = { 1UL << 30, 2UL << 20 };
+
+static unsigned long place_hole_huge(struct kexec_info *info,
+	unsigned long hole_size, unsigned long hole_align,
+	unsigned long hole_min, unsigned long hole_max,
+	int hole_end)
+{
+	unsigned long base, align;
+	size_t i;
+
+	for (i = 0; huge_align && i < sizeof(huge_align_size) /
+		    sizeof(huge_align_size[0]); i++) {
+		align = huge_align_size[i];
+		if (hole_size < align || hole_align >= align)
+			continue;
+		base = place_hole(info, hole_size, align, hole_min, hole_max,
+				  hole_end, 1);
+		if (base != ULONG_MAX)
+			return base;
+	}
+	return place_hole(info, hole_size, hole_align, hole_min, hole_max,
+			  hole_end, 0);
+}
+
+/*
+ * Merge segments that follow each other both in memory and in their
+ * buffers, so the kernel has fewer, bigger segments to relocate.
+ */
+static void merge_segments(struct kexec_info *info)
+{
+	struct kexec_segment *prev, *seg;
+	int i, j;
+
+	for (i = 1, j = 0; i < info->nr_segments; i++) {
+		prev = &info->segment[j];
+		seg = &info->segment[i];
+		if (prev->bufsz == prev->memsz &&
+		    (const char *)prev->buf + prev->bufsz == seg->buf &&
+		    (const char *)prev->mem + prev->memsz == seg->mem) {
+			prev->bufsz += seg->bufsz;
+			prev->memsz += seg->memsz;
+			continue;
+		}
+		info->segment[++j] = *seg;
+	}
+	if (info->nr_segments)
+		info->nr_segments = j + 1;
+}
+
+/* How many segments start on a 1G, 2M, 64K or only a page boundary */
+static void print_segment_alignment(FILE *f, struct kexec_info *info)
+{
+	static const unsigned long size[] = { 1UL << 30, 2UL << 20, 1UL << 16 };
+	static const char *const name[] = { "1G", "2M", "64K", "page" };
+	int count[4] = { 0 };
+	unsigned long mem;
+	int i, j;
+
+	for (j = 0; j < info->nr_segments; j++) {
+		mem = (unsigned long)info->segment[j].mem;
+		for (i = 0; i < 3; i++)
+			if (!(mem & (size[i] - 1)))
+				break;
+		count[i]++;
+	}
+	fprintf(f, "segment alignment:");
+	for (i = 0; i < 4; i++)
+		fprintf(f, " %s %d", name[i], count[i]);
+	fprintf(f, "\n");
+}
+
 void add_segment_phys_virt(struct kexec_info *info,
 	const void *buf, size_t bufsz,
 	unsigned long base, size_t memsz, int phys)
@@ -376,7 +605,8 @@ unsigned long add_buffer_phys_virt(struct kexec_info *info,
 	pagesize = getpagesize();
 	memsz = _ALIGN(memsz, pagesize);
 
-	base = locate_hole(info, memsz, buf_align, buf_min, buf_max, buf_end);
+	base = place_hole_huge(info, memsz, buf_align, buf_min, buf_max,
+			       buf_end);
 	if (base == ULONG_MAX) {
 		die("locate_hole failed\n");
 	}
@@ -481,13 +711,14 @@ static int add_backup_segments(struct kexec_info *info,
 	return 0;
 }
 
-static char *slurp_fd(int fd, const char *filename, off_t size, off_t *nread)
+/* Read up to size bytes of fd into buf, then close fd */
+static int read_fd(int fd, const char *filename, char *buf, off_t size,
+		   off_t *nread)
 {
-	char *buf;
 	off_t progress;
 	ssize_t result;
 
-	buf = xmalloc(size);
+	stats_start(STAT_SLURP);
 	progress = 0;
 	while (progress < size) {
 		result = read(fd, buf + progress, size - progress);
@@ -496,9 +727,9 @@ static char *slurp_fd(int fd, const char *filename, off_t size, off_t *nread)
 				continue;
 			fprintf(stderr, "Read on %s failed: %s\n", filename,
 				strerror(errno));
-			free(buf);
 			close(fd);
-			return NULL;
+			stats_end(STAT_SLURP, progress);
+			return -1;
 		}
 		if (result == 0)
 			/* EOF */
@@ -508,24 +739,170 @@ static char *slurp_fd(int fd, const char *filename, off_t size, off_t *nread)
 	result = close(fd);
 	if (result < 0)
 		die("Close of %s failed: %s\n", filename, strerror(errno));
+	stats_end(STAT_SLURP, progress);
 
 	if (nread)
 		*nread = progress;
-	return buf;
+	return 0;
 }
 
-char *slurp_file(const char *filename, off_t *r_size)
+/* Write all of buf to fd, returns 0 or -1 with errno set */
+int write_all(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+	ssize_t result;
+
+	while (size) {
+		result = write(fd, p, size);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += result;
+		size -= result;
+	}
+	return 0;
+}
+
+/*
+ * Replace filename safely: open_tmpfile() creates a uniquely named file
+ * next to it, returning its descriptor and name, and close_tmpfile()
+ * syncs that and renames it over filename, or removes it if err is set
+ * or anything fails.  Concurrent writers never share a temporary file,
+ * so filename is always one complete version.  Both return -1 with
+ * errno set on failure.
+ */
+int open_tmpfile(const char *filename, char **r_tmp)
 {
+	char *tmp;
 	int fd;
+
+	tmp = xmalloc(strlen(filename) + 8);
+	sprintf(tmp, "%s.XXXXXX", filename);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return -1;
+	}
+	*r_tmp = tmp;
+	return fd;
+}
+
+int close_tmpfile(int fd, char *tmp, const char *filename, int err)
+{
+	int saved_errno;
+
+	if (!err && fsync(fd) < 0)
+		err = -1;
+	if (close(fd) < 0)
+		err = -1;
+	if (!err && rename(tmp, filename) < 0)
+		err = -1;
+	if (err) {
+		saved_errno = errno;
+		unlink(tmp);
+		errno = saved_errno;
+	}
+	free(tmp);
+	return err ? -1 : 0;
+}
+
+static char *slurp_fd(int fd, const char *filename, off_t size, off_t *nread)
+{
 	char *buf;
-	off_t size, err, nread;
-	ssize_t result;
+
+	buf = xmalloc(size);
+	if (read_fd(fd, filename, buf, size, nread) < 0) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+/*
+ * Kernels and initrds can also be streamed in on an inherited file
+ * descriptor: "-" is stdin, and /dev/fd/N or /proc/self/fd/N read fd N
+ * directly instead of reopening it, which would fail for a socket.
+ * Returns the fd, or -1 if filename is an ordinary path.
+ */
+static int stream_fd(const char *filename)
+{
+	const char *p;
+	char *end;
+	long fd;
+
+	if (strcmp(filename, "-") == 0)
+		return STDIN_FILENO;
+	if (strncmp(filename, "/dev/fd/", 8) == 0)
+		p = filename + 8;
+	else if (strncmp(filename, "/proc/self/fd/", 14) == 0)
+		p = filename + 14;
+	else
+		return -1;
+	fd = strtol(p, &end, 10);
+	if (end == p || *end || fd < 0 || fd > INT_MAX)
+		return -1;
+	return fd;
+}
+
+/*
+ * Read a stream of unknown length, growing the buffer geometrically.
+ * A memfd or other regular file is read from its start whatever its
+ * current offset, as if it had been reopened, and its size is used to
+ * size the buffer.  The fd is left open: it isn't ours.
+ */
+static char *slurp_stream(int fd, const char *filename, off_t *r_size)
+{
 	struct stat stats;
+	off_t size, allocated;
+	ssize_t result;
+	int seekable = 0;
+	char *buf;
 
-	if (!filename) {
-		*r_size = 0;
-		return 0;
+	allocated = 1 << 20;
+	if (fstat(fd, &stats) == 0 && S_ISREG(stats.st_mode)) {
+		seekable = 1;
+		/* One spare byte, so EOF is seen without growing */
+		allocated = stats.st_size + 1;
 	}
+	buf = xmalloc(allocated);
+
+	stats_start(STAT_SLURP);
+	size = 0;
+	for (;;) {
+		if (size == allocated) {
+			allocated <<= 1;
+			buf = xrealloc(buf, allocated);
+		}
+		if (seekable)
+			result = pread(fd, buf + size, allocated - size, size);
+		else
+			result = read(fd, buf + size, allocated - size);
+		if (result < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			die("Read on %s failed: %s\n", filename,
+			    strerror(errno));
+		}
+		if (result == 0)
+			break;
+		size += result;
+	}
+	stats_end(STAT_SLURP, size);
+
+	*r_size = size;
+	return buf;
+}
+
+/* Open filename for slurping and return its size in *r_size */
+static int open_slurp(const char *filename, off_t *r_size)
+{
+	int fd;
+	off_t size, err;
+	ssize_t result;
+	struct stat stats;
+
 	fd = open(filename, O_RDONLY | _O_BINARY);
 	if (fd < 0) {
 		die("Cannot open `%s': %s\n",
@@ -556,6 +933,25 @@ char *slurp_file(const char *filename, off_t *r_size)
 		size = stats.st_size;
 	}
 
+	*r_size = size;
+	return fd;
+}
+
+char *slurp_file(const char *filename, off_t *r_size)
+{
+	int fd;
+	char *buf;
+	off_t size, nread;
+
+	if (!filename) {
+		*r_size = 0;
+		return 0;
+	}
+	fd = stream_fd(filename);
+	if (fd >= 0)
+		return slurp_stream(fd, filename, r_size);
+	fd = open_slurp(filename, &size);
+
 	buf = slurp_fd(fd, filename, size, &nread);
 	if (!buf)
 		die("Cannot read %s", filename);
@@ -567,6 +963,157 @@ char *slurp_file(const char *filename, off_t *r_size)
 	return buf;
 }
 
+/* Files given with --initrd-append, in order */
+static const char **initrd_append;
+static int initrd_append_nr, initrd_append_used;
+
+/* --initrd-fd */
+static const char *initrd_stream;
+static int initrd_stream_used;
+
+/*
+ * The initrd a loader should read: the one given with its --initrd
+ * option, else the stream given with --initrd-fd, else none.
+ */
+const char *initrd_path(const char *ramdisk)
+{
+	if (ramdisk)
+		return ramdisk;
+	if (initrd_stream)
+		initrd_stream_used = 1;
+	return initrd_stream;
+}
+
+/*
+ * Open the initrd for kexec_file_load().  initrd_fd_opened remembers
+ * an fd opened here, as opposed to a stream fd, for my_file_load() to
+ * close.
+ */
+static int initrd_fd_opened = -1;
+
+int open_initrd(const char *filename)
+{
+	int fd;
+
+	fd = stream_fd(filename);
+	if (fd >= 0)
+		return fd;
+	fd = open(filename, O_RDONLY | _O_BINARY);
+	if (fd < 0)
+		die("Cannot open `%s': %s\n", filename, strerror(errno));
+	initrd_fd_opened = fd;
+	return fd;
+}
+
+/*
+ * Read the initrd followed by any --initrd-append files straight into
+ * one buffer, so a per-host cpio can be added to a shared initramfs
+ * without building a combined image first.  Each piece is zero padded
+ * to 4 bytes; the kernel skips the padding between archives.
+ */
+char *slurp_initrd(const char *filename, off_t *r_size)
+{
+	int i, nr, *fds;
+	off_t *sizes, total, offset, nread;
+	const char *name;
+	char *buf, **streamed;
+
+	if (!filename) {
+		*r_size = 0;
+		return 0;
+	}
+
+	initrd_append_used = 1;
+	nr = initrd_append_nr + 1;
+	/* A lone streamed initrd needs no copy, except into Xen memory */
+	if (nr == 1 && stream_fd(filename) >= 0 && !xen_present())
+		return slurp_file(filename, r_size);
+
+	fds = xmalloc(nr * sizeof(*fds));
+	sizes = xmalloc(nr * sizeof(*sizes));
+	streamed = xmalloc(nr * sizeof(*streamed));
+	total = 0;
+	for (i = 0; i < nr; i++) {
+		name = i ? initrd_append[i - 1] : filename;
+		/* Streams have no size until they have been read */
+		fds[i] = stream_fd(name);
+		if (fds[i] >= 0)
+			streamed[i] = slurp_stream(fds[i], name, &sizes[i]);
+		else {
+			streamed[i] = NULL;
+			fds[i] = open_slurp(name, &sizes[i]);
+		}
+		total += i < nr - 1 ? _ALIGN(sizes[i], 4) : sizes[i];
+	}
+
+	/*
+	 * Under Xen, read the initrd straight into memory that can be
+	 * handed to the hypercall, saving a copy of what is usually the
+	 * biggest segment.
+	 */
+	buf = xen_present() ? xen_seg_alloc(total) : NULL;
+	if (!buf)
+		buf = xmalloc(total);
+	offset = 0;
+	for (i = 0; i < nr; i++) {
+		name = i ? initrd_append[i - 1] : filename;
+		if (streamed[i]) {
+			memcpy(buf + offset, streamed[i], sizes[i]);
+			free(streamed[i]);
+		} else {
+			if (read_fd(fds[i], name, buf + offset, sizes[i],
+				    &nread) < 0)
+				die("Cannot read %s", name);
+			if (nread != sizes[i])
+				die("Read on %s ended before stat said it "
+				    "should\n", name);
+		}
+		offset += sizes[i];
+		if (i < nr - 1) {
+			memset(buf + offset, 0, _ALIGN(sizes[i], 4) - sizes[i]);
+			offset = _ALIGN(offset, 4);
+		}
+	}
+	free(streamed);
+	free(sizes);
+	free(fds);
+
+	*r_size = total;
+	return buf;
+}
+
+/*
+ * For loaders that hand the initrd to the kernel untouched: map a lone
+ * initrd file read-only instead of reading it into memory.  Streams,
+ * --initrd-append and Xen still go through slurp_initrd().
+ */
+const char *map_initrd(const char *filename, off_t *r_size)
+{
+	struct stat stats;
+	void *buf;
+	int fd;
+
+	if (!filename || initrd_append_nr || stream_fd(filename) >= 0 ||
+	    xen_present())
+		return slurp_initrd(filename, r_size);
+
+	fd = open(filename, O_RDONLY | _O_BINARY);
+	if (fd < 0)
+		die("Cannot open `%s': %s\n", filename, strerror(errno));
+	if (fstat(fd, &stats) < 0 || !S_ISREG(stats.st_mode) ||
+	    stats.st_size == 0) {
+		close(fd);
+		return slurp_initrd(filename, r_size);
+	}
+	buf = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return slurp_initrd(filename, r_size);
+
+	*r_size = stats.st_size;
+	return buf;
+}
+
 /* This functions reads either specified number of bytes from the file or
    lesser if EOF is met. */
 
@@ -586,36 +1133,170 @@ char *slurp_file_len(const char *filename, off_t size, off_t *nread)
 	return slurp_fd(fd, filename, size, nread);
 }
 
+/*
+ * Tell what slurp_decompress_file() would make of data starting with
+ * buf: gzip, xz, lzma_alone with the usual lc/lp/pb properties byte, or
+ * nothing it can decompress.
+ */
+int compress_magic(const void *buf, off_t len)
+{
+	static const unsigned char xz_magic[6] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+	const unsigned char *p = buf;
+
+	if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+		return COMPRESS_GZIP;
+	if (len >= 6 && (memcmp(p, xz_magic, sizeof(xz_magic)) == 0 ||
+			 (p[0] == 0x5d && p[1] == 0 && p[2] == 0)))
+		return COMPRESS_LZMA;
+	return COMPRESS_NONE;
+}
+
 char *slurp_decompress_file(const char *filename, off_t *r_size)
 {
-	char *kernel_buf;
+	char *kernel_buf, *buf;
+	off_t size;
+
+	if (filename && stream_fd(filename) >= 0) {
+		/* A stream can only be read once, so decompress in memory */
+		buf = slurp_file(filename, &size);
+		stats_start(STAT_DECOMPRESS);
+		kernel_buf = zlib_decompress_buf(buf, size, r_size);
+		if (!kernel_buf)
+			kernel_buf = lzma_decompress_buf(buf, size, r_size);
+		stats_end(STAT_DECOMPRESS, kernel_buf ? *r_size : 0);
+		if (!kernel_buf) {
+			*r_size = size;
+			return buf;
+		}
+		free(buf);
+		return kernel_buf;
+	}
 
+	stats_start(STAT_DECOMPRESS);
 	kernel_buf = zlib_decompress_file(filename, r_size);
-	if (!kernel_buf) {
+	if (!kernel_buf)
 		kernel_buf = lzma_decompress_file(filename, r_size);
-		if (!kernel_buf)
-			return slurp_file(filename, r_size);
-	}
+	stats_end(STAT_DECOMPRESS, kernel_buf ? *r_size : 0);
+	if (!kernel_buf)
+		return slurp_file(filename, r_size);
 	return kernel_buf;
 }
 
-static void update_purgatory(struct kexec_info *info)
+/* --verify */
+static int verify_policy = VERIFY_SHA256;
+static unsigned long verify_stride = VERIFY_STRIDE_DEFAULT;
+
+struct verify_ctx {
+	sha256_context sha;
+	uint32_t crc;
+};
+
+static void verify_update(struct verify_ctx *ctx, const uint8_t *buf,
+			  unsigned long len)
+{
+	if (verify_policy == VERIFY_CRC32C)
+		ctx->crc = crc32c(ctx->crc, buf, len);
+	else
+		sha256_update(&ctx->sha, buf, len);
+}
+
+/*
+ * Checksum len bytes at offset off of a segment, as purgatory will see
+ * them once loaded: the buffer followed by zeroes up to memsz.
+ */
+static void verify_segment_range(struct verify_ctx *ctx,
+				 const struct kexec_segment *seg,
+				 unsigned long off, unsigned long len)
 {
 	static const uint8_t null_buf[256];
-	sha256_context ctx;
+
+	if (off < seg->bufsz) {
+		unsigned long bytes = seg->bufsz - off;
+		if (bytes > len)
+			bytes = len;
+		verify_update(ctx, (const uint8_t *)seg->buf + off, bytes);
+		len -= bytes;
+	}
+	while(len) {
+		unsigned long bytes = len;
+		if (bytes > sizeof(null_buf)) {
+			bytes = sizeof(null_buf);
+		}
+		verify_update(ctx, null_buf, bytes);
+		len -= bytes;
+	}
+}
+
+/*
+ * Checksum a whole segment, or with VERIFY_SAMPLED the first VERIFY_CHUNK
+ * bytes of every verify_stride chunks, the same way purgatory does.
+ * Returns the number of bytes checksummed.
+ */
+static unsigned long verify_segment(struct verify_ctx *ctx,
+				    const struct kexec_segment *seg)
+{
+	unsigned long step, off, len, total = 0;
+
+	if (verify_policy != VERIFY_SAMPLED) {
+		verify_segment_range(ctx, seg, 0, seg->memsz);
+		return seg->memsz;
+	}
+	step = VERIFY_CHUNK * verify_stride;
+	for (off = 0; off < seg->memsz; off += step) {
+		len = seg->memsz - off;
+		if (len > VERIFY_CHUNK)
+			len = VERIFY_CHUNK;
+		verify_segment_range(ctx, seg, off, len);
+		total += len;
+	}
+	return total;
+}
+
+/* Parse sha256, crc32c, sampled[:N] or none */
+static int parse_verify(const char *arg)
+{
+	char *endptr;
+
+	if (strcmp(arg, "sha256") == 0)
+		verify_policy = VERIFY_SHA256;
+	else if (strcmp(arg, "crc32c") == 0)
+		verify_policy = VERIFY_CRC32C;
+	else if (strcmp(arg, "none") == 0)
+		verify_policy = VERIFY_NONE;
+	else if (strncmp(arg, "sampled", 7) == 0) {
+		verify_policy = VERIFY_SAMPLED;
+		verify_stride = VERIFY_STRIDE_DEFAULT;
+		if (arg[7] == ':') {
+			verify_stride = strtoul(arg + 8, &endptr, 0);
+			if (*endptr || !verify_stride ||
+			    verify_stride > UINT32_MAX / VERIFY_CHUNK)
+				return -1;
+		} else if (arg[7])
+			return -1;
+	} else
+		return -1;
+	return 0;
+}
+
+static void update_purgatory(struct kexec_info *info)
+{
+	struct verify_ctx ctx;
 	sha256_digest_t digest;
 	struct sha256_region region[SHA256_REGIONS];
+	uint32_t policy = verify_policy, stride = verify_stride;
 	int i, j;
+	unsigned long long hashed = 0;
 	/* Don't do anything if we are not using purgatory */
 	if (!info->rhdr.e_shdr) {
 		return;
 	}
+	stats_start(STAT_PURGATORY);
 	arch_update_purgatory(info);
 	memset(region, 0, sizeof(region));
-	sha256_starts(&ctx);
+	sha256_starts(&ctx.sha);
+	ctx.crc = 0;
 	/* Compute a hash of the loaded kernel */
 	for(j = i = 0; i < info->nr_segments; i++) {
-		unsigned long nullsz;
 		/* Don't include purgatory in the checksum.  The stack
 		 * in the bss will definitely change, and the .data section
 		 * will also change when we poke the sha256_digest in there.
@@ -624,26 +1305,171 @@ static void update_purgatory(struct kexec_info *info)
 		if (info->segment[i].mem == (void *)info->rhdr.rel_addr) {
 			continue;
 		}
-		sha256_update(&ctx, info->segment[i].buf,
-			      info->segment[i].bufsz);
-		nullsz = info->segment[i].memsz - info->segment[i].bufsz;
-		while(nullsz) {
-			unsigned long bytes = nullsz;
-			if (bytes > sizeof(null_buf)) {
-				bytes = sizeof(null_buf);
-			}
-			sha256_update(&ctx, null_buf, bytes);
-			nullsz -= bytes;
-		}
+		/* The regions are still needed with --verify=none, the
+		 * s390 purgatory uses them to find the crash kernel.
+		 */
+		if (verify_policy != VERIFY_NONE)
+			hashed += verify_segment(&ctx, &info->segment[i]);
 		region[j].start = (unsigned long) info->segment[i].mem;
 		region[j].len   = info->segment[i].memsz;
 		j++;
 	}
-	sha256_finish(&ctx, digest);
 	elf_rel_set_symbol(&info->rhdr, "sha256_regions", &region,
 			   sizeof(region));
-	elf_rel_set_symbol(&info->rhdr, "sha256_digest", &digest,
-			   sizeof(digest));
+	elf_rel_set_symbol(&info->rhdr, "verify_policy", &policy,
+			   sizeof(policy));
+	if (verify_policy == VERIFY_SAMPLED)
+		elf_rel_set_symbol(&info->rhdr, "verify_stride", &stride,
+				   sizeof(stride));
+	if (verify_policy == VERIFY_CRC32C) {
+		elf_rel_set_symbol(&info->rhdr, "crc32c_digest", &ctx.crc,
+				   sizeof(ctx.crc));
+	} else if (verify_policy != VERIFY_NONE) {
+		sha256_finish(&ctx.sha, digest);
+		elf_rel_set_symbol(&info->rhdr, "sha256_digest", &digest,
+				   sizeof(digest));
+	}
+	stats_end(STAT_PURGATORY, hashed);
+}
+
+/* Hand the finished segments to the kernel */
+static int do_kexec_load(struct kexec_info *info)
+{
+	int result;
+
+	printf("kexec_load: entry = %p flags = 0x%lx\n",
+		  info->entry, info->kexec_flags);
+	print_segments(stderr, info);
+
+	stats_start(STAT_SYSCALL);
+	if (xen_present())
+		result = xen_kexec_load(info);
+	else
+		result = dev_kexec_load(info->entry,
+				    info->nr_segments, info->segment,
+				    info->kexec_flags);
+	stats_end(STAT_SYSCALL, segments_size(info));
+	if (result != 0) {
+		/* The load failed, print some debugging information */
+		fprintf(stderr, "kexec_load failed: %s\n", 
+			strerror(errno));
+		fprintf(stderr, "entry       = %p flags = 0x%lx\n", 
+			info->entry, info->kexec_flags);
+		print_segments(stderr, info);
+	}
+	return result;
+}
+
+static int probe_file_type(int i, const char *kernel_buf, off_t kernel_size)
+{
+	int result;
+
+	stats_start(STAT_PROBE);
+	result = file_type[i].probe(kernel_buf, kernel_size);
+	stats_end(STAT_PROBE, 0);
+	return result;
+}
+
+/* Return the KERNEL_MAGIC_* bits found at the start of the kernel */
+static unsigned int kernel_magic(const char *buf, off_t len)
+{
+	unsigned int magic = 0;
+	uint32_t word;
+	off_t i, end;
+
+	if (len >= SELFMAG && memcmp(buf, ELFMAG, SELFMAG) == 0)
+		magic |= KERNEL_MAGIC_ELF;
+	if (len >= 0x206 && memcmp(buf + 0x202, "HdrS", 4) == 0)
+		magic |= KERNEL_MAGIC_BZIMAGE;
+	if (len >= 4) {
+		memcpy(&word, buf, sizeof(word));
+		if (be32_to_cpu(word) == IH_MAGIC)
+			magic |= KERNEL_MAGIC_UIMAGE;
+	}
+	end = len < MULTIBOOT_SEARCH ? len : MULTIBOOT_SEARCH;
+	for (i = 0; i + 12 <= end; i += 4) {
+		memcpy(&word, buf + i, sizeof(word));
+		if (word == MULTIBOOT_MAGIC) {
+			magic |= KERNEL_MAGIC_MULTIBOOT;
+			break;
+		}
+	}
+	return magic;
+}
+
+/*
+ * The file type found for a kernel file, kept in the firmware cache so
+ * that loading the same file again goes straight to its probe.
+ */
+struct probe_cache_entry {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	char type[32];
+};
+
+static int probe_cache_key(const char *kernel, struct probe_cache_entry *key)
+{
+	struct stat st;
+
+	memset(key, 0, sizeof(*key));
+	if (stat(kernel, &st) < 0 || !S_ISREG(st.st_mode))
+		return -1;
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->size = st.st_size;
+	key->mtime = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	return 0;
+}
+
+/*
+ * Return the index of the first file type whose probe accepts the
+ * kernel, or file_types if none does.  Types whose magic the kernel
+ * lacks are skipped without calling their probe.
+ */
+static int find_file_type(const char *kernel, const char *kernel_buf,
+			  off_t kernel_size)
+{
+	const struct probe_cache_entry *cached;
+	struct probe_cache_entry key;
+	unsigned int magic;
+	size_t size;
+	int i, have_key;
+
+	have_key = probe_cache_key(kernel, &key) == 0;
+	if (have_key) {
+		cached = fw_cache_get("probe-type", &size);
+		if (cached && size == sizeof(*cached) &&
+		    memcmp(cached, &key, offsetof(struct probe_cache_entry,
+						  type)) == 0) {
+			for (i = 0; i < file_types; i++) {
+				if (strncmp(file_type[i].name, cached->type,
+					    sizeof(cached->type)) != 0)
+					continue;
+				/* Still probe it, probes may set up state */
+				if (probe_file_type(i, kernel_buf,
+						    kernel_size) == 0)
+					return i;
+				break;
+			}
+		}
+	}
+
+	magic = kernel_magic(kernel_buf, kernel_size);
+	for (i = 0; i < file_types; i++) {
+		if ((file_type[i].magic & magic) != file_type[i].magic)
+			continue;
+		if (probe_file_type(i, kernel_buf, kernel_size) == 0)
+			break;
+	}
+	if (have_key && i < file_types) {
+		strncpy(key.type, file_type[i].name, sizeof(key.type) - 1);
+		fw_cache_put("probe-type", &key, sizeof(key));
+	}
+	return i;
 }
 
 /*
@@ -652,7 +1478,7 @@ static void update_purgatory(struct kexec_info *info)
 static int my_load(const char *type, int fileind, int argc, char **argv,
 		   unsigned long kexec_flags, void *entry)
 {
-	char *kernel;
+	const char *kernel;
 	char *kernel_buf;
 	off_t kernel_size;
 	int i = 0;
@@ -669,20 +1495,26 @@ static int my_load(const char *type, int fileind, int argc, char **argv,
 	info.kexec_flags = kexec_flags;
 
 	result = 0;
-	if (argc - fileind <= 0) {
+	if (kernel_stream) {
+		kernel = kernel_stream;
+	} else if (argc - fileind <= 0) {
 		fprintf(stderr, "No kernel specified\n");
 		usage();
 		return -1;
+	} else {
+		kernel = argv[fileind];
 	}
-	kernel = argv[fileind];
 	/* slurp in the input kernel */
 	kernel_buf = slurp_decompress_file(kernel, &kernel_size);
 
 	dbgprintf("kernel: %p kernel_size: 0x%lx\n",
 		  kernel_buf, kernel_size);
 
-	if (get_memory_ranges(&info.memory_range, &info.memory_ranges,
-		info.kexec_flags) < 0 || info.memory_ranges == 0) {
+	stats_start(STAT_MEMORY_RANGES);
+	result = get_memory_ranges(&info.memory_range, &info.memory_ranges,
+				   info.kexec_flags);
+	stats_end(STAT_MEMORY_RANGES, 0);
+	if (result < 0 || info.memory_ranges == 0) {
 		fprintf(stderr, "Could not get memory layout\n");
 		return -1;
 	}
@@ -697,15 +1529,12 @@ static int my_load(const char *type, int fileind, int argc, char **argv,
 			return -1;
 		} else {
 			/* make sure our file is really of that type */
-			if (file_type[i].probe(kernel_buf, kernel_size) < 0)
+			if (probe_file_type(i, kernel_buf, kernel_size) < 0)
 				guess_only = 1;
 		}
 	}
 	if (!type || guess_only) {
-		for (i = 0; i < file_types; i++) {
-			if (file_type[i].probe(kernel_buf, kernel_size) == 0)
-				break;
-		}
+		i = find_file_type(kernel, kernel_buf, kernel_size);
 		if (i == file_types) {
 			fprintf(stderr, "Cannot determine the file type "
 					"of %s\n", kernel);
@@ -726,7 +1555,9 @@ static int my_load(const char *type, int fileind, int argc, char **argv,
 	}
 	info.kexec_flags |= native_arch;
 
+	stats_start(STAT_ARCH_LOAD);
 	result = file_type[i].load(argc, argv, kernel_buf, kernel_size, &info);
+	stats_end(STAT_ARCH_LOAD, segments_size(&info));
 	if (result < 0) {
 		switch (result) {
 		case ENOCRASHKERNEL:
@@ -766,26 +1597,54 @@ static int my_load(const char *type, int fileind, int argc, char **argv,
 	update_purgatory(&info);
 	if (entry)
 		info.entry = entry;
+	if (huge_align) {
+		merge_segments(&info);
+		print_segment_alignment(stderr, &info);
+	} else if (kexec_debug) {
+		print_segment_alignment(stderr, &info);
+	}
 
-	printf("kexec_load: entry = %p flags = 0x%lx\n",
-		  info.entry, info.kexec_flags);
-	print_segments(stderr, &info);
-
-	if (xen_present())
-		result = xen_kexec_load(&info);
-	else
-		result = dev_kexec_load(info.entry,
-				    info.nr_segments, info.segment,
-				    info.kexec_flags);
-	if (result != 0) {
-		/* The load failed, print some debugging information */
-		fprintf(stderr, "kexec_load failed: %s\n", 
-			strerror(errno));
-		fprintf(stderr, "entry       = %p flags = 0x%lx\n", 
-			info.entry, info.kexec_flags);
+	if (prepare_file) {
 		print_segments(stderr, &info);
+		return write_load_state(prepare_file, &info);
 	}
-	return result;
+
+	return do_kexec_load(&info);
+}
+
+/*
+ * Load a kernel laid out earlier by --prepare.  The state file holds
+ * the final segments, so all that is left is to check them against
+ * the current memory layout.
+ */
+static int my_commit(const char *filename)
+{
+	struct kexec_info info;
+	int i, result;
+
+	memset(&info, 0, sizeof(info));
+	if (read_load_state(filename, &info) < 0)
+		return -1;
+
+	stats_start(STAT_MEMORY_RANGES);
+	result = get_memory_ranges(&info.memory_range, &info.memory_ranges,
+				   info.kexec_flags);
+	stats_end(STAT_MEMORY_RANGES, 0);
+	if (result < 0 || info.memory_ranges == 0) {
+		fprintf(stderr, "Could not get memory layout\n");
+		return -1;
+	}
+	for (i = 0; i < info.nr_segments; i++) {
+		if (!valid_memory_segment(&info, info.segment +i)) {
+			fprintf(stderr, "Invalid memory segment %p - %p\n",
+				info.segment[i].mem,
+				((char *)info.segment[i].mem) +
+				info.segment[i].memsz);
+			return -1;
+		}
+	}
+
+	return do_kexec_load(&info);
 }
 
 static int k_unload (unsigned long kexec_flags)
@@ -800,7 +1659,18 @@ static int k_unload (unsigned long kexec_flags)
 	}
 	kexec_flags |= native_arch;
 
-	if (xen_present())
+	if (use_file_syscall) {
+		result = kexec_file_load(-1, -1, 0, NULL, KEXEC_FILE_UNLOAD |
+			(kexec_flags & KEXEC_ON_CRASH ? KEXEC_FILE_ON_CRASH : 0));
+		/*
+		 * Without the syscall, or after an earlier -s load fell
+		 * back to it, the image is the driver's.
+		 */
+		if ((result != 0 && errno == ENOSYS) ||
+		    (result == 0 && dev_kexec_present() &&
+		     dev_kexec_check_loaded() > 0))
+			result = dev_kexec_load(NULL, 0, NULL, kexec_flags);
+	} else if (xen_present())
 		result = xen_kexec_unload(kexec_flags);
 	else
 		result = dev_kexec_load(NULL, 0, NULL, kexec_flags);
@@ -837,7 +1707,12 @@ static int my_shutdown(void)
  */
 static int my_exec(void)
 {
-	if (xen_present())
+	if (use_file_syscall) {
+		reboot(LINUX_REBOOT_CMD_KEXEC);
+		/* Nothing loaded that way, the image may be the driver's */
+		if (dev_kexec_present())
+			dev_kexec_reboot(LINUX_REBOOT_CMD_KEXEC);
+	} else if (xen_present())
 		xen_kexec_exec();
 	else
 		dev_kexec_reboot(LINUX_REBOOT_CMD_KEXEC);
@@ -859,6 +1734,119 @@ static int load_jump_back_helper_image(unsigned long kexec_flags, void *entry)
 	return result;
 }
 
+/* my_file_load() couldn't be used, try my_load() */
+#define FILE_LOAD_FALLBACK	1
+
+/*
+ * Load with kexec_file_load(): the kernel reads, verifies and places the
+ * kernel and initrd itself, so no segments or purgatory are built and
+ * nothing is copied or hashed here.  Returns FILE_LOAD_FALLBACK if the
+ * running kernel or the image type doesn't support it.
+ */
+static int my_file_load(const char *type, int fileind, int argc,
+			char **argv, unsigned long kexec_flags)
+{
+	struct kexec_info info;
+	const char *kernel;
+	struct stat stats;
+	char *kernel_buf;
+	unsigned long flags = 0;
+	int kernel_fd, i, result;
+
+	if (xen_present() || (kexec_flags & KEXEC_PRESERVE_CONTEXT) ||
+	    initrd_append_nr)
+		return FILE_LOAD_FALLBACK;
+
+	memset(&info, 0, sizeof(info));
+	info.kexec_flags = kexec_flags;
+	info.file_mode = 1;
+	info.initrd_fd = -1;
+
+	if (kernel_stream) {
+		kernel = kernel_stream;
+	} else if (argc - fileind <= 0) {
+		fprintf(stderr, "No kernel specified\n");
+		usage();
+		return -1;
+	} else {
+		kernel = argv[fileind];
+	}
+	kernel_fd = stream_fd(kernel);
+	if (kernel_fd < 0) {
+		kernel_fd = open(kernel, O_RDONLY | _O_BINARY);
+		if (kernel_fd < 0) {
+			fprintf(stderr, "Cannot open `%s': %s\n", kernel,
+				strerror(errno));
+			return -1;
+		}
+	}
+	/* Pipes and sockets have to be read in by my_load() */
+	result = FILE_LOAD_FALLBACK;
+	if (fstat(kernel_fd, &stats) < 0 || !S_ISREG(stats.st_mode) ||
+	    stats.st_size == 0)
+		goto out;
+
+	/* Probing only needs to look, so map the kernel instead of reading it */
+	kernel_buf = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE,
+			  kernel_fd, 0);
+	if (kernel_buf == MAP_FAILED)
+		goto out;
+	if (type) {
+		for (i = 0; i < file_types; i++)
+			if (strcmp(type, file_type[i].name) == 0)
+				break;
+		if (i < file_types &&
+		    probe_file_type(i, kernel_buf, stats.st_size) != 0)
+			i = file_types;
+	} else {
+		i = find_file_type(kernel, kernel_buf, stats.st_size);
+	}
+	if (i == file_types || !(file_type[i].flags & FILE_TYPE_FILE_LOAD)) {
+		munmap(kernel_buf, stats.st_size);
+		goto out;
+	}
+
+	stats_start(STAT_ARCH_LOAD);
+	result = file_type[i].load(argc, argv, kernel_buf, stats.st_size,
+				   &info);
+	stats_end(STAT_ARCH_LOAD, 0);
+	munmap(kernel_buf, stats.st_size);
+	if (result < 0) {
+		fprintf(stderr, "Cannot load %s\n", kernel);
+		goto out;
+	}
+
+	if (kexec_flags & KEXEC_ON_CRASH)
+		flags |= KEXEC_FILE_ON_CRASH;
+	if (info.initrd_fd < 0)
+		flags |= KEXEC_FILE_NO_INITRAMFS;
+	dbgprintf("kexec_file_load: kernel_fd = %d initrd_fd = %d "
+		  "cmdline = \"%s\" flags = 0x%lx\n", kernel_fd,
+		  info.initrd_fd, info.command_line, flags);
+
+	stats_start(STAT_SYSCALL);
+	result = kexec_file_load(kernel_fd, info.initrd_fd,
+				 info.command_line_len, info.command_line,
+				 flags);
+	stats_end(STAT_SYSCALL, 0);
+	if (result != 0 && errno == ENOSYS) {
+		fprintf(stderr, "kexec_file_load isn't supported by this "
+			"kernel, using kexec_load\n");
+		result = FILE_LOAD_FALLBACK;
+	} else if (result != 0) {
+		fprintf(stderr, "kexec_file_load failed: %s\n",
+			strerror(errno));
+	}
+out:
+	if (stream_fd(kernel) < 0)
+		close(kernel_fd);
+	if (info.initrd_fd >= 0 && info.initrd_fd == initrd_fd_opened) {
+		close(info.initrd_fd);
+		initrd_fd_opened = -1;
+	}
+	return result;
+}
+
 /*
  *	Jump back to the original kernel
  */
@@ -912,12 +1900,26 @@ void usage(void)
 	       "                      If capture kernel is being unloaded\n"
 	       "                      specify -p with -u.\n"
 	       " -e, --exec           Execute a currently loaded kernel.\n"
+	       " -s, --kexec-file-syscall Load, unload and execute with the\n"
+	       "                      kexec_file_load and reboot syscalls,\n"
+	       "                      letting the kernel read the kernel\n"
+	       "                      and initrd itself where supported.\n"
 	       " -t, --type=TYPE      Specify the new kernel is of this type.\n"
 	       "     --mem-min=<addr> Specify the lowest memory address to\n"
 	       "                      load code into.\n"
 	       "     --mem-max=<addr> Specify the highest memory address to\n"
 	       "                      load code into.\n"
 	       "     --reuseinitrd    Reuse initrd from first boot.\n"
+	       "     --prepare=<file> Lay the new kernel out as for --load, but\n"
+	       "                      save the result in file instead of\n"
+	       "                      loading it.\n"
+	       "     --commit=<file>  Load a kernel saved with --prepare.\n"
+	       "     --initrd-append=<file> Append file to the initrd; may be\n"
+	       "                      given more than once.\n"
+	       "     --kernel-fd=<fd> Read the kernel from file descriptor fd,\n"
+	       "                      e.g. a pipe, socket or memfd.\n"
+	       "     --initrd-fd=<fd> Read the initrd from file descriptor fd\n"
+	       "                      if --initrd isn't given.\n"
 	       "     --load-preserve-context Load the new kernel and preserve\n"
 	       "                      context of current kernel during kexec.\n"
 	       "     --load-jump-back-helper Load a helper image to jump back\n"
@@ -927,6 +1929,19 @@ void usage(void)
 	       "                      preserve context)\n"
 	       "                      to original kernel.\n"
 	       " -d, --debug           Enable debugging to help spot a failure.\n"
+	       "     --stats[=json]   Print the time spent in each phase of\n"
+	       "                      the load.\n"
+	       "     --verify=<how>   How purgatory checks the new kernel\n"
+	       "                      before starting it: sha256 (default),\n"
+	       "                      crc32c, sampled[:N] or none.\n"
+	       "     --placement=<how> Where to put the segments on NUMA\n"
+	       "                      machines: any (default), node0,\n"
+	       "                      spread or node:N.\n"
+	       "     --huge-align     Put big segments on 2M or 1G boundaries\n"
+	       "                      where there is room.\n"
+	       "     --fw-cache[=<file>] Reuse firmware state saved by an\n"
+	       "                      earlier load in this boot, and save it\n"
+	       "                      for later ones (default " FW_CACHE_FILE ").\n"
 	       "\n"
 	       "Supported kernel file types and options: \n");
 	for (i = 0; i < file_types; i++) {
@@ -938,9 +1953,8 @@ void usage(void)
 	printf("\n");
 }
 
-static int kexec_loaded(void)
+static int kexec_loaded_sysfs(void)
 {
-#if 0
 	long ret = -1;
 	FILE *fp;
 	char *p;
@@ -971,8 +1985,20 @@ static int kexec_loaded(void)
 		return -1;
 
 	return (int)ret;
-#endif
-	return dev_kexec_check_loaded();
+}
+
+/* Is a kernel loaded with whichever interface loaded it? */
+static int kexec_loaded(void)
+{
+	int loaded;
+
+	if (!use_file_syscall)
+		return dev_kexec_check_loaded();
+	loaded = kexec_loaded_sysfs();
+	/* An -s load that fell back to the driver isn't seen in sysfs */
+	if (loaded <= 0 && dev_kexec_present())
+		loaded = dev_kexec_check_loaded();
+	return loaded;
 }
 
 /*
@@ -1077,6 +2103,20 @@ char *concat_cmdline(const char *base, const char *append)
 }
 
 
+/* Turn a --kernel-fd/--initrd-fd argument into a name for slurp_file() */
+static const char *fd_file(const char *arg)
+{
+	char *end, *name;
+	long fd;
+
+	fd = strtol(arg, &end, 10);
+	if (end == arg || *end || fd < 0 || fd > INT_MAX)
+		return NULL;
+	name = xmalloc(32);
+	snprintf(name, 32, "/dev/fd/%ld", fd);
+	return name;
+}
+
 int main(int argc, char *argv[])
 {
 	int do_load = 1;
@@ -1087,6 +2127,9 @@ int main(int argc, char *argv[])
 	int do_ifdown = 0;
 	int do_unload = 0;
 	int do_reuse_initrd = 0;
+	const char *fw_cache_file = NULL;
+	const char *commit_file = NULL;
+	const char *stream;
 	void *entry = 0;
 	char *type = 0;
 	char *endptr;
@@ -1126,6 +2169,9 @@ int main(int argc, char *argv[])
 			do_exec = 0;
 			do_shutdown = 0;
 			break;
+		case OPT_KEXEC_FILE_SYSCALL:
+			use_file_syscall = 1;
+			break;
 		case OPT_UNLOAD:
 			do_load = 0;
 			do_shutdown = 0;
@@ -1198,6 +2244,74 @@ int main(int argc, char *argv[])
 		case OPT_REUSE_INITRD:
 			do_reuse_initrd = 1;
 			break;
+		case OPT_STATS:
+			if (!optarg)
+				stats_init(STATS_TEXT);
+			else if (strcmp(optarg, "json") == 0)
+				stats_init(STATS_JSON);
+			else {
+				fprintf(stderr, "Unknown --stats format %s\n",
+					optarg);
+				usage();
+				return 1;
+			}
+			break;
+		case OPT_VERIFY:
+			if (parse_verify(optarg) < 0) {
+				fprintf(stderr, "Bad option value in --verify=%s\n",
+					optarg);
+				usage();
+				return 1;
+			}
+			break;
+		case OPT_PLACEMENT:
+			if (parse_placement(optarg) < 0) {
+				fprintf(stderr, "Bad option value in --placement=%s\n",
+					optarg);
+				usage();
+				return 1;
+			}
+			break;
+		case OPT_HUGE_ALIGN:
+			huge_align = 1;
+			break;
+		case OPT_FW_CACHE:
+			fw_cache_file = optarg ? optarg : FW_CACHE_FILE;
+			break;
+		case OPT_PREPARE:
+			do_load = 1;
+			do_exec = 0;
+			do_shutdown = 0;
+			do_sync = 0;
+			prepare_file = optarg;
+			break;
+		case OPT_COMMIT:
+			do_load = 0;
+			do_exec = 0;
+			do_shutdown = 0;
+			do_sync = 0;
+			commit_file = optarg;
+			break;
+		case OPT_KERNEL_FD:
+		case OPT_INITRD_FD:
+			stream = fd_file(optarg);
+			if (!stream) {
+				fprintf(stderr, "Bad file descriptor %s\n",
+					optarg);
+				usage();
+				return 1;
+			}
+			if (opt == OPT_KERNEL_FD)
+				kernel_stream = stream;
+			else
+				initrd_stream = stream;
+			break;
+		case OPT_INITRD_APPEND:
+			initrd_append = xrealloc(initrd_append,
+						 (initrd_append_nr + 1) *
+						 sizeof(*initrd_append));
+			initrd_append[initrd_append_nr++] = optarg;
+			break;
 		default:
 			break;
 		}
@@ -1218,6 +2332,9 @@ int main(int argc, char *argv[])
 		    "\"--mem-max\" parameter\n");
 	}
 
+	if (do_load && fw_cache_file)
+		fw_cache_open(fw_cache_file);
+
 	fileind = optind;
 	/* Reset getopt for the next pass; called in other source modules */
 	opterr = 1;
@@ -1244,9 +2361,30 @@ int main(int argc, char *argv[])
 	if (do_unload) {
 		result = k_unload(kexec_flags);
 	}
-	if (do_load && (result == 0)) {
-		result = my_load(type, fileind, argc, argv, kexec_flags, entry);
+	if (commit_file && (result == 0)) {
+		result = my_commit(commit_file);
 	}
+	if (do_load && (result == 0)) {
+		result = FILE_LOAD_FALLBACK;
+		if (use_file_syscall && !prepare_file)
+			result = my_file_load(type, fileind, argc, argv,
+					      kexec_flags);
+		if (result == FILE_LOAD_FALLBACK) {
+			/* Loaded through /dev/kexec, so exec it from there */
+			use_file_syscall = 0;
+			result = my_load(type, fileind, argc, argv,
+					 kexec_flags, entry);
+		}
+		if (result == 0)
+			fw_cache_save();
+		if (result == 0 && initrd_append_nr && !initrd_append_used)
+			fprintf(stderr, "Warning: --initrd-append was ignored, "
+				"it needs --initrd\n");
+		if (result == 0 && initrd_stream && !initrd_stream_used)
+			fprintf(stderr, "Warning: --initrd-fd was ignored\n");
+	}
+	if (do_load || commit_file)
+		stats_print(stderr);
 	/* Don't shutdown unless there is something to reboot to! */
 	if ((result == 0) && (do_shutdown || do_exec) && !kexec_loaded()) {
 		die("Nothing has been loaded!\n");
@@ -156,6 +156,15 @@ struct kexec_info {
 	unsigned long kexec_flags;
 	unsigned long backup_src_start;
 	unsigned long backup_src_size;
+
+	/*
+	 * Set for kexec_file_load(): the loader only parses its options
+	 * and fills in the initrd and command line below.
+	 */
+	int file_mode;
+	int initrd_fd;
+	char *command_line;
+	int command_line_len;
 };
 
 struct arch_map_entry {
@@ -187,13 +196,28 @@ typedef int (load_t )(int argc, char **argv,
 	const char *kernel_buf, off_t kernel_size, 
 	struct kexec_info *info);
 typedef void (usage_t)(void);
+/*
+ * Magic numbers found by a cheap scan of the start of the kernel before
+ * any probe runs.  A file type that sets magic is only probed if the
+ * kernel carries all of it.
+ */
+#define KERNEL_MAGIC_ELF	(1 << 0)	/* ELFMAG at 0 */
+#define KERNEL_MAGIC_BZIMAGE	(1 << 1)	/* "HdrS" at 0x202 */
+#define KERNEL_MAGIC_UIMAGE	(1 << 2)	/* IH_MAGIC at 0 */
+#define KERNEL_MAGIC_MULTIBOOT	(1 << 3)	/* header in the first 8KB */
+
 struct file_type {
 	const char *name;
 	probe_t *probe;
 	load_t  *load;
 	usage_t *usage;
+	unsigned int magic;
+	unsigned int flags;
 };
 
+/* file_type.flags */
+#define FILE_TYPE_FILE_LOAD	(1 << 0)	/* handles info->file_mode */
+
 extern struct file_type file_type[];
 extern int file_types;
 
@@ -205,6 +229,7 @@ extern int file_types;
 #define OPT_EXEC		'e'
 #define OPT_LOAD		'l'
 #define OPT_UNLOAD		'u'
+#define OPT_KEXEC_FILE_SYSCALL	's'
 #define OPT_TYPE		't'
 #define OPT_PANIC		'p'
 #define OPT_MEM_MIN             256
@@ -213,7 +238,17 @@ extern int file_types;
 #define OPT_LOAD_PRESERVE_CONTEXT 259
 #define OPT_LOAD_JUMP_BACK_HELPER 260
 #define OPT_ENTRY		261
-#define OPT_MAX			262
+#define OPT_FW_CACHE		262
+#define OPT_INITRD_APPEND	263
+#define OPT_PREPARE		264
+#define OPT_COMMIT		265
+#define OPT_STATS		266
+#define OPT_KERNEL_FD		267
+#define OPT_INITRD_FD		268
+#define OPT_VERIFY		269
+#define OPT_PLACEMENT		270
+#define OPT_HUGE_ALIGN		271
+#define OPT_MAX			272
 #define KEXEC_OPTIONS \
 	{ "help",		0, 0, OPT_HELP }, \
 	{ "version",		0, 0, OPT_VERSION }, \
@@ -221,6 +256,7 @@ extern int file_types;
 	{ "no-ifdown",		0, 0, OPT_NOIFDOWN }, \
 	{ "load",		0, 0, OPT_LOAD }, \
 	{ "unload",		0, 0, OPT_UNLOAD }, \
+	{ "kexec-file-syscall",	0, 0, OPT_KEXEC_FILE_SYSCALL }, \
 	{ "exec",		0, 0, OPT_EXEC }, \
 	{ "load-preserve-context", 0, 0, OPT_LOAD_PRESERVE_CONTEXT}, \
 	{ "load-jump-back-helper", 0, 0, OPT_LOAD_JUMP_BACK_HELPER }, \
@@ -231,17 +267,38 @@ extern int file_types;
 	{ "mem-max",		1, 0, OPT_MEM_MAX }, \
 	{ "reuseinitrd",	0, 0, OPT_REUSE_INITRD }, \
 	{ "debug",		0, 0, OPT_DEBUG }, \
-
-#define KEXEC_OPT_STR "h?vdfxluet:p"
+	{ "fw-cache",		2, 0, OPT_FW_CACHE }, \
+	{ "initrd-append",	1, 0, OPT_INITRD_APPEND }, \
+	{ "prepare",		1, 0, OPT_PREPARE }, \
+	{ "commit",		1, 0, OPT_COMMIT }, \
+	{ "stats",		2, 0, OPT_STATS }, \
+	{ "kernel-fd",		1, 0, OPT_KERNEL_FD }, \
+	{ "initrd-fd",		1, 0, OPT_INITRD_FD }, \
+	{ "verify",		1, 0, OPT_VERIFY }, \
+	{ "placement",		1, 0, OPT_PLACEMENT }, \
+	{ "huge-align",		0, 0, OPT_HUGE_ALIGN }, \
+
+#define KEXEC_OPT_STR "h?vdfxluet:ps"
 
 extern void dbgprint_mem_range(const char *prefix, struct memory_range *mr, int nr_mr);
 extern void die(const char *fmt, ...)
 	__attribute__ ((format (printf, 1, 2)));
 extern void *xmalloc(size_t size);
 extern void *xrealloc(void *ptr, size_t size);
+extern int write_all(int fd, const void *buf, size_t size);
+extern int open_tmpfile(const char *filename, char **r_tmp);
+extern int close_tmpfile(int fd, char *tmp, const char *filename, int err);
 extern char *slurp_file(const char *filename, off_t *r_size);
 extern char *slurp_file_len(const char *filename, off_t size, off_t *nread);
 extern char *slurp_decompress_file(const char *filename, off_t *r_size);
+#define COMPRESS_NONE	0
+#define COMPRESS_GZIP	1
+#define COMPRESS_LZMA	2
+extern int compress_magic(const void *buf, off_t len);
+extern char *slurp_initrd(const char *filename, off_t *r_size);
+extern const char *map_initrd(const char *filename, off_t *r_size);
+extern const char *initrd_path(const char *ramdisk);
+extern int open_initrd(const char *filename);
 extern unsigned long virt_to_phys(unsigned long addr);
 extern void add_segment(struct kexec_info *info,
 	const void *buf, size_t bufsz, unsigned long base, size_t memsz);
@@ -294,6 +351,7 @@ char *concat_cmdline(const char *base, const char *append);
 
 int xen_present(void);
 int xen_kexec_load(struct kexec_info *info);
+void *xen_seg_alloc(size_t size);
 int xen_kexec_unload(uint64_t kexec_flags);
 void xen_kexec_exec(void);
 
@@ -195,9 +195,54 @@ char *lzma_decompress_file(const char *filename, off_t *r_size)
 	*r_size =  size;
 	return buf;
 }
+
+/*
+ * Decompress an xz or lzma image that is already in memory.  Returns
+ * NULL if in isn't one, so the caller can use it as is.
+ */
+char *lzma_decompress_buf(const char *in, off_t in_size, off_t *r_size)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_ret ret;
+	char *buf;
+	off_t allocated;
+
+	if (compress_magic(in, in_size) != COMPRESS_LZMA)
+		return NULL;
+
+	if (lzma_auto_decoder(&strm, UINT64_C(64) * 1024 * 1024, 0) != LZMA_OK)
+		return NULL;
+	allocated = in_size * 4;
+	buf = xmalloc(allocated);
+	strm.next_in = (const uint8_t *)in;
+	strm.avail_in = in_size;
+	do {
+		if (strm.total_out == (uint64_t)allocated) {
+			allocated <<= 1;
+			buf = xrealloc(buf, allocated);
+		}
+		strm.next_out = (uint8_t *)buf + strm.total_out;
+		strm.avail_out = allocated - strm.total_out;
+		ret = lzma_code(&strm, LZMA_FINISH);
+	} while (ret == LZMA_OK);
+	if (ret != LZMA_STREAM_END) {
+		lzma_end(&strm);
+		free(buf);
+		return NULL;
+	}
+	*r_size = strm.total_out;
+	lzma_end(&strm);
+	return buf;
+}
 #else
 char *lzma_decompress_file(const char *UNUSED(filename), off_t *UNUSED(r_size))
 {
 	return NULL;
 }
+
+char *lzma_decompress_buf(const char *UNUSED(in), off_t UNUSED(in_size),
+			  off_t *UNUSED(r_size))
+{
+	return NULL;
+}
 #endif /* HAVE_LIBLZMA */
@@ -0,0 +1,147 @@
+/*
+ * numa.c: Find the memory of each NUMA node
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include "kexec.h"
+#include "numa.h"
+
+#define NODE_DIR	"/sys/devices/system/node"
+#define BLOCK_SIZE	"/sys/devices/system/memory/block_size_bytes"
+
+static struct numa_node *numa_node;
+static int numa_nr_nodes = -1;
+
+static int compare_block(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int compare_node(const void *a, const void *b)
+{
+	return ((const struct numa_node *)a)->id -
+	       ((const struct numa_node *)b)->id;
+}
+
+/* Turn the memory<N> entries of a node directory into ranges */
+static void read_node(struct numa_node *node, const char *path,
+		      unsigned long long block_size)
+{
+	unsigned long *block = NULL, nr = 0, alloc = 0, i;
+	unsigned long n;
+	struct dirent *dp;
+	char *end;
+	DIR *dir;
+
+	node->nr_ranges = 0;
+	node->range = NULL;
+	dir = opendir(path);
+	if (!dir)
+		return;
+	while ((dp = readdir(dir)) != NULL) {
+		if (strncmp(dp->d_name, "memory", 6))
+			continue;
+		n = strtoul(dp->d_name + 6, &end, 10);
+		if (end == dp->d_name + 6 || *end)
+			continue;
+		if (nr == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			block = xrealloc(block, alloc * sizeof(*block));
+		}
+		block[nr++] = n;
+	}
+	closedir(dir);
+	if (!nr)
+		return;
+
+	qsort(block, nr, sizeof(*block), compare_block);
+	node->range = xmalloc(nr * sizeof(*node->range));
+	for (i = 0; i < nr; i++) {
+		struct memory_range *r = &node->range[node->nr_ranges];
+
+		if (node->nr_ranges &&
+		    r[-1].end + 1 == block[i] * block_size) {
+			r[-1].end += block_size;
+			continue;
+		}
+		r->start = block[i] * block_size;
+		r->end = r->start + block_size - 1;
+		r->type = RANGE_RAM;
+		node->nr_ranges++;
+	}
+	free(block);
+}
+
+/*
+ * Return the number of NUMA nodes with memory and point *nodes at them,
+ * sorted by id.  Returns 0 if the kernel doesn't list node memory,
+ * e.g. without memory hotplug support.  The result is read once.
+ */
+int numa_nodes(struct numa_node **nodes)
+{
+	unsigned long long block_size = 0;
+	char path[PATH_MAX];
+	struct dirent *dp;
+	int alloc = 0, id;
+	char *end;
+	FILE *fp;
+	DIR *dir;
+
+	if (numa_nr_nodes >= 0)
+		goto out;
+	numa_nr_nodes = 0;
+
+	fp = fopen(BLOCK_SIZE, "r");
+	if (!fp)
+		goto out;
+	if (fscanf(fp, "%llx", &block_size) != 1)
+		block_size = 0;
+	fclose(fp);
+	if (!block_size)
+		goto out;
+
+	dir = opendir(NODE_DIR);
+	if (!dir)
+		goto out;
+	while ((dp = readdir(dir)) != NULL) {
+		if (strncmp(dp->d_name, "node", 4))
+			continue;
+		id = strtol(dp->d_name + 4, &end, 10);
+		if (end == dp->d_name + 4 || *end)
+			continue;
+		if (numa_nr_nodes == alloc) {
+			alloc = alloc ? alloc * 2 : 8;
+			numa_node = xrealloc(numa_node,
+					     alloc * sizeof(*numa_node));
+		}
+		snprintf(path, sizeof(path), "%s/%s", NODE_DIR, dp->d_name);
+		numa_node[numa_nr_nodes].id = id;
+		read_node(&numa_node[numa_nr_nodes], path, block_size);
+		if (numa_node[numa_nr_nodes].nr_ranges)
+			numa_nr_nodes++;
+	}
+	closedir(dir);
+	qsort(numa_node, numa_nr_nodes, sizeof(*numa_node), compare_node);
+out:
+	*nodes = numa_node;
+	return numa_nr_nodes;
+}
@@ -0,0 +1,19 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "kexec.h"
+
+/*
+ * The physical memory of one NUMA node, as listed by the memory blocks
+ * under /sys/devices/system/node/node<id>.  Ranges are sorted and
+ * adjacent blocks merged.
+ */
+struct numa_node {
+	int id;
+	int nr_ranges;
+	struct memory_range *range;
+};
+
+int numa_nodes(struct numa_node **nodes);
+
+#endif /* NUMA_H */
@@ -70,9 +70,56 @@ char *zlib_decompress_file(const char *filename, off_t *r_size)
 	*r_size =  size;
 	return buf;
 }
+
+/*
+ * Decompress a gzip image that is already in memory.  Returns NULL if
+ * in isn't gzip data, so the caller can use it as is.
+ */
+char *zlib_decompress_buf(const char *in, off_t in_size, off_t *r_size)
+{
+	z_stream strm;
+	char *buf;
+	off_t allocated;
+	int ret;
+
+	if (compress_magic(in, in_size) != COMPRESS_GZIP)
+		return NULL;
+
+	memset(&strm, 0, sizeof(strm));
+	/* 32: accept a gzip header */
+	if (inflateInit2(&strm, 15 + 32) != Z_OK)
+		return NULL;
+	allocated = in_size * 4;
+	buf = xmalloc(allocated);
+	strm.next_in = (Bytef *)in;
+	strm.avail_in = in_size;
+	do {
+		if (strm.total_out == (uLong)allocated) {
+			allocated <<= 1;
+			buf = xrealloc(buf, allocated);
+		}
+		strm.next_out = (Bytef *)buf + strm.total_out;
+		strm.avail_out = allocated - strm.total_out;
+		ret = inflate(&strm, Z_NO_FLUSH);
+	} while (ret == Z_OK);
+	if (ret != Z_STREAM_END) {
+		inflateEnd(&strm);
+		free(buf);
+		return NULL;
+	}
+	*r_size = strm.total_out;
+	inflateEnd(&strm);
+	return buf;
+}
 #else
 char *zlib_decompress_file(const char *UNUSED(filename), off_t *UNUSED(r_size))
 {
 	return NULL;
 }
+
+char *zlib_decompress_buf(const char *UNUSED(in), off_t UNUSED(in_size),
+			  off_t *UNUSED(r_size))
+{
+	return NULL;
+}
 #endif /* HAVE_ZLIB */
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Run kexec against dev-kexec-shim.so: usage dev-kexec-check.sh <kexec> <shim>
+#
+# Each case presets whether the stand-in driver holds an image, runs
+# kexec and checks its exit status, what the driver was asked to do and
+# that /dev/kexec was opened at most once.
+#
+KEXEC=$1
+SHIM=$2
+KEXEC_SHIM_STATE=$(mktemp)
+LOG=$(mktemp)
+export KEXEC_SHIM_STATE
+fail=0
+
+# check <loaded before> <expected status> <expected loaded after> <log pattern> <kexec args...>
+check()
+{
+	before=$1 status=$2 after=$3 pattern=$4
+	shift 4
+	echo "$before" > "$KEXEC_SHIM_STATE"
+	LD_PRELOAD=$SHIM "$KEXEC" "$@" > "$LOG" 2>&1
+	got=$?
+	if [ "$got" -ne "$status" ] ||
+	   [ "$(cat "$KEXEC_SHIM_STATE")" -ne "$after" ] ||
+	   ! grep -q "$pattern" "$LOG" ||
+	   [ "$(grep -c "shim: open" "$LOG")" -gt 1 ]; then
+		echo "FAIL: kexec $* (status $got)"
+		cat "$LOG"
+		fail=1
+	else
+		echo "ok: kexec $*"
+	fi
+}
+
+check 1 0 0 "shim: load 0 segments" -u
+check 1 0 0 "shim: load 0 segments" -s -u
+check 1 0 0 "shim: load 0 segments flags 0x.*1$" -s -p -u
+check 1 0 1 "shim: reboot$" -e
+check 0 1 0 "Nothing has been loaded" -e
+check 1 0 1 "shim: reboot$" -s -e
+check 0 1 0 "Nothing has been loaded" -s -e
+
+rm -f "$KEXEC_SHIM_STATE" "$LOG"
+exit $fail
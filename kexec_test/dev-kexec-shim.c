@@ -0,0 +1,258 @@
+/*
+ * dev-kexec-shim.c: Stand-in for the vendor /dev/kexec driver
+ *
+ * Preload this into kexec to run the /dev/kexec backend without the
+ * driver, and without booting anything:
+ *
+ *	KEXEC_SHIM_STATE=/tmp/state LD_PRELOAD=dev-kexec-shim.so kexec ...
+ *
+ * open("/dev/kexec") hands out a descriptor for /dev/null and the
+ * KEXEC_IOC_* ioctls on it are answered here.  Whether an image is
+ * loaded is kept in the KEXEC_SHIM_STATE file, so a load and a later
+ * exec can be separate runs.  The shim models a kernel without
+ * kexec_file_load(), which fails with ENOSYS, and reboot(2) fails as
+ * it does when nothing was loaded with the syscalls.  An exec of a
+ * loaded image exits with status 0 instead of booting it.
+ *
+ * Loads cost what they would with a kernel behind them: the LOAD ioctl
+ * copies the segments in, and with KEXEC_SHIM_FILE_LOAD set
+ * kexec_file_load() succeeds after reading the kernel and initrd files
+ * in whole, as kernel_read_file() does.
+ *
+ * Every call is logged to stderr as "shim: ..." for a test to match.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <linux/reboot.h>
+#include "../kexec/kexec-dev.h"
+#include "../kexec/kexec-syscall.h"
+
+#define DEV_KEXEC	"/dev/kexec"
+
+static int shim_fd = -1;
+
+/* struct kexec_segment as the driver and kexec_load() take it */
+struct shim_segment {
+	const void *buf;
+	size_t bufsz;
+	const void *mem;
+	size_t memsz;
+};
+
+static int state_get(void)
+{
+	const char *path = getenv("KEXEC_SHIM_STATE");
+	int loaded = 0;
+	FILE *fp;
+
+	if (path && (fp = fopen(path, "r")) != NULL) {
+		if (fscanf(fp, "%d", &loaded) != 1)
+			loaded = 0;
+		fclose(fp);
+	}
+	return loaded;
+}
+
+static void state_set(int loaded)
+{
+	const char *path = getenv("KEXEC_SHIM_STATE");
+	FILE *fp;
+
+	if (path && (fp = fopen(path, "w")) != NULL) {
+		fprintf(fp, "%d\n", loaded);
+		fclose(fp);
+	}
+}
+
+/* Copy the segments in, as the driver does */
+static int shim_copy_segments(const struct shim_segment *seg, int nr)
+{
+	void *copy;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!seg[i].bufsz)
+			continue;
+		copy = malloc(seg[i].bufsz);
+		if (!copy)
+			return -1;
+		memcpy(copy, seg[i].buf, seg[i].bufsz);
+		free(copy);
+	}
+	return 0;
+}
+
+/* Read all of fd into memory, as kernel_read_file() does */
+static int shim_read_fd(int fd)
+{
+	struct stat st;
+	ssize_t result;
+	off_t offset;
+	char *buf;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return -1;
+	buf = malloc(st.st_size ? st.st_size : 1);
+	if (!buf)
+		return -1;
+	for (offset = 0; offset < st.st_size; offset += result) {
+		result = pread(fd, buf + offset, st.st_size - offset, offset);
+		if (result <= 0) {
+			free(buf);
+			return -1;
+		}
+	}
+	free(buf);
+	return 0;
+}
+
+static int shim_open(const char *path, int flags, mode_t mode,
+		     const char *real)
+{
+	int (*real_open)(const char *, int, ...);
+
+	real_open = dlsym(RTLD_NEXT, real);
+	if (strcmp(path, DEV_KEXEC) != 0)
+		return real_open(path, flags, mode);
+	shim_fd = real_open("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+	fprintf(stderr, "shim: open fd %d\n", shim_fd);
+	return shim_fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return shim_open(path, flags, mode, "open");
+}
+
+int open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return shim_open(path, flags, mode, "open64");
+}
+
+int access(const char *path, int how)
+{
+	int (*real_access)(const char *, int);
+
+	if (strcmp(path, DEV_KEXEC) == 0)
+		return 0;
+	real_access = dlsym(RTLD_NEXT, "access");
+	return real_access(path, how);
+}
+
+int ioctl(int fd, unsigned long req, ...)
+{
+	int (*real_ioctl)(int, unsigned long, ...);
+	struct kexec_param *param;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	if (fd < 0 || fd != shim_fd) {
+		real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+		return real_ioctl(fd, req, arg);
+	}
+
+	/* kexec-dev.c passes an int, the kernel only looks at 32 bits */
+	switch ((unsigned int)req) {
+	case KEXEC_IOC_LOAD:
+		param = arg;
+		fprintf(stderr, "shim: load %d segments flags 0x%lx\n",
+			param->nr_segments, param->kexec_flags);
+		if (shim_copy_segments((const struct shim_segment *)
+				       param->segment, param->nr_segments)) {
+			errno = ENOMEM;
+			return -1;
+		}
+		state_set(param->nr_segments != 0);
+		return 0;
+	case KEXEC_IOC_REBOOT:
+		if (!state_get()) {
+			fprintf(stderr, "shim: reboot, nothing loaded\n");
+			errno = EINVAL;
+			return -1;
+		}
+		fprintf(stderr, "shim: reboot\n");
+		exit(0);
+	case KEXEC_IOC_CHECK_LOADED:
+		fprintf(stderr, "shim: check loaded %d\n", state_get());
+		return state_get();
+	}
+	errno = ENOTTY;
+	return -1;
+}
+
+long syscall(long nr, ...)
+{
+	long (*real_syscall)(long, ...);
+	long a[6];
+	va_list ap;
+	int i;
+
+	va_start(ap, nr);
+	for (i = 0; i < 6; i++)
+		a[i] = va_arg(ap, long);
+	va_end(ap);
+#ifdef __NR_kexec_file_load
+	if (nr == __NR_kexec_file_load && !getenv("KEXEC_SHIM_FILE_LOAD")) {
+		fprintf(stderr, "shim: kexec_file_load\n");
+		errno = ENOSYS;
+		return -1;
+	}
+	if (nr == __NR_kexec_file_load) {
+		/* kernel fd, initrd fd, cmdline len, cmdline, flags */
+		fprintf(stderr, "shim: kexec_file_load flags 0x%lx\n", a[4]);
+		if (a[4] & KEXEC_FILE_UNLOAD) {
+			state_set(0);
+			return 0;
+		}
+		if (shim_read_fd(a[0]) < 0 ||
+		    (!(a[4] & KEXEC_FILE_NO_INITRAMFS) && shim_read_fd(a[1]) < 0)) {
+			errno = EINVAL;
+			return -1;
+		}
+		state_set(1);
+		return 0;
+	}
+#endif
+	real_syscall = dlsym(RTLD_NEXT, "syscall");
+	return real_syscall(nr, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+int reboot(int cmd)
+{
+	fprintf(stderr, "shim: reboot(2) 0x%x\n", cmd);
+	errno = EINVAL;
+	return -1;
+}
@@ -0,0 +1,236 @@
+/*
+ * file-load-bench.c: Time kexec -l against kexec -s -l
+ *
+ * Writes a made up relocatable bzImage and an initrd to a scratch
+ * directory and loads them repeatedly under dev-kexec-shim.so, once
+ * through the segment path (kexec_load via /dev/kexec) and once through
+ * kexec_file_load().  The shim does the copying a kernel would, so the
+ * times compare what each path costs end to end.  Each run must take
+ * the path it is meant to; the best and mean times are printed.
+ *
+ *	file-load-bench <kexec> <shim> [initrd megabytes [runs]]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define KERNEL_SIZE	(8 << 20)	/* of the protected mode part */
+#define SETUP_SECTS	4
+
+static char dir[] = "/tmp/file-load-bench.XXXXXX";
+static char kernel[64], initrd[64], state[64], log_file[64];
+
+static void put16(unsigned char *p, unsigned v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(unsigned char *p, unsigned long v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+static int write_file(const char *name, const void *buf, size_t size)
+{
+	int fd, result;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+	result = write(fd, buf, size) == (ssize_t)size ? 0 : -1;
+	if (close(fd) < 0)
+		result = -1;
+	return result;
+}
+
+/* Just enough of a bzImage for the bzImage64 loader to accept it */
+static int write_kernel(void)
+{
+	size_t setup = (SETUP_SECTS + 1) * 512, i;
+	unsigned char *buf;
+	int result;
+
+	buf = calloc(1, setup + KERNEL_SIZE);
+	if (!buf)
+		return -1;
+	buf[0x1f1] = SETUP_SECTS;
+	put16(buf + 0x1fe, 0xaa55);
+	buf[0x200] = 0xeb;			/* jmp to the end of the header */
+	buf[0x201] = 0x6a;
+	memcpy(buf + 0x202, "HdrS", 4);
+	put16(buf + 0x206, 0x020f);		/* boot protocol 2.15 */
+	buf[0x211] = 1;				/* LOADED_HIGH */
+	put32(buf + 0x230, 2 << 20);		/* kernel_alignment */
+	buf[0x234] = 1;				/* relocatable_kernel */
+	put16(buf + 0x236, 3);			/* KERNEL_64, above 4G */
+	put32(buf + 0x238, 2048);		/* cmdline_size */
+	put32(buf + 0x260, 2 * KERNEL_SIZE);	/* init_size */
+	for (i = setup; i < setup + KERNEL_SIZE; i++)
+		buf[i] = i * 7;
+	result = write_file(kernel, buf, setup + KERNEL_SIZE);
+	free(buf);
+	return result;
+}
+
+static int write_initrd(size_t size)
+{
+	unsigned char *buf;
+	size_t i;
+	int result;
+
+	buf = malloc(size);
+	if (!buf)
+		return -1;
+	for (i = 0; i < size; i++)
+		buf[i] = i * 13;
+	result = write_file(initrd, buf, size);
+	free(buf);
+	return result;
+}
+
+/* Does file contain str? */
+static int file_has(const char *name, const char *str)
+{
+	char line[256];
+	int found = 0;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f)
+		return 0;
+	while (!found && fgets(line, sizeof(line), f))
+		found = strstr(line, str) != NULL;
+	fclose(f);
+	return found;
+}
+
+static void print_file(const char *name)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		fputs(line, stderr);
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One kexec run; returns its time or -1 if it failed or took the wrong path */
+static double run(const char *kexec, int file_load)
+{
+	char initrd_opt[80];
+	double t0, t1;
+	int status, fd;
+	pid_t pid;
+
+	snprintf(initrd_opt, sizeof(initrd_opt), "--initrd=%s", initrd);
+	if (write_file(state, "0\n", 2) < 0)
+		return -1;
+	t0 = now();
+	pid = fork();
+	if (pid == 0) {
+		fd = open(log_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 ||
+		    dup2(fd, STDERR_FILENO) < 0)
+			_exit(127);
+		if (file_load)
+			execl(kexec, kexec, "-s", "-l", kernel, initrd_opt,
+			      (char *)NULL);
+		else
+			execl(kexec, kexec, "-l", kernel, initrd_opt,
+			      (char *)NULL);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0)
+		return -1;
+	t1 = now();
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+	    !file_has(state, "1") ||
+	    file_has(log_file, "shim: load") == file_load ||
+	    file_has(log_file, "shim: kexec_file_load") != file_load) {
+		fprintf(stderr, "kexec %s-l did not load as expected:\n",
+			file_load ? "-s " : "");
+		print_file(log_file);
+		return -1;
+	}
+	return t1 - t0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *const name[] = { "kexec_load", "kexec_file_load" };
+	size_t mb = argc > 3 ? strtoul(argv[3], NULL, 0) : 64;
+	int runs = argc > 4 ? atoi(argv[4]) : 5;
+	double t, best, total;
+	int mode, i, failed = 0;
+
+	if (argc < 3 || !mb || runs <= 0) {
+		fprintf(stderr, "usage: %s <kexec> <shim> "
+			"[initrd megabytes [runs]]\n", argv[0]);
+		return 1;
+	}
+	if (!mkdtemp(dir)) {
+		fprintf(stderr, "Can't create a scratch directory: %s\n",
+			strerror(errno));
+		return 1;
+	}
+	snprintf(kernel, sizeof(kernel), "%s/bzImage", dir);
+	snprintf(initrd, sizeof(initrd), "%s/initrd", dir);
+	snprintf(state, sizeof(state), "%s/state", dir);
+	snprintf(log_file, sizeof(log_file), "%s/log", dir);
+	if (write_kernel() < 0 || write_initrd(mb << 20) < 0) {
+		fprintf(stderr, "Can't write the test images: %s\n",
+			strerror(errno));
+		failed = 1;
+		goto out;
+	}
+	setenv("KEXEC_SHIM_STATE", state, 1);
+	setenv("KEXEC_SHIM_FILE_LOAD", "1", 1);
+	setenv("LD_PRELOAD", argv[2], 1);
+
+	for (mode = 0; mode < 2 && !failed; mode++) {
+		best = total = 0;
+		for (i = 0; i < runs; i++) {
+			t = run(argv[1], mode);
+			if (t < 0) {
+				failed = 1;
+				break;
+			}
+			if (!i || t < best)
+				best = t;
+			total += t;
+		}
+		if (!failed)
+			printf("%-15s 8 MB kernel, %zu MB initrd: best %.1f ms, "
+			       "mean %.1f ms\n", name[mode], mb, best * 1e3,
+			       total / runs * 1e3);
+	}
+out:
+	unlink(kernel);
+	unlink(initrd);
+	unlink(state);
+	unlink(log_file);
+	rmdir(dir);
+	return failed;
+}
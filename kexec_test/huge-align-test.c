@@ -0,0 +1,166 @@
+/*
+ * huge-align-test.c: Check --huge-align placement on made up memory maps
+ *
+ * kexec.c is built into this program, with its main() renamed, so the
+ * static placement helpers can be driven directly: buffers are added to
+ * a kexec_info whose memory map is set up here, and the addresses they
+ * get, the merged segments and the alignment histogram are checked.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#define main kexec_main
+#include "../kexec/kexec.c"
+#undef main
+
+#define SZ_2M	0x200000UL
+#define SZ_1G	0x40000000UL
+
+static int failed;
+
+#define expect(cond, ...) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);	\
+		fprintf(stderr, __VA_ARGS__);				\
+		failed = 1;						\
+	}								\
+} while (0)
+
+static void set_ram(struct kexec_info *info, const struct memory_range *range,
+		    int nr)
+{
+	free(info->segment);
+	memset(info, 0, sizeof(*info));
+	info->memory_range = (struct memory_range *)range;
+	info->memory_ranges = nr;
+}
+
+static unsigned long add(struct kexec_info *info, unsigned long size,
+			 int end)
+{
+	return add_buffer(info, NULL, 0, size, getpagesize(), 0, ULONG_MAX,
+			  end);
+}
+
+/* Big buffers go on 1G, then 2M boundaries, and only with --huge-align */
+static void test_align(struct kexec_info *info)
+{
+	static const struct memory_range ram[] = {
+		{ 0x100000, 0xbfefffff, RANGE_RAM },
+	};
+	unsigned long base;
+
+	set_ram(info, ram, 1);
+	huge_align = 0;
+	base = add(info, 4 << 20, -1);
+	expect(base == 0xbfb00000, "4M without --huge-align at 0x%lx\n",
+	       base);
+
+	set_ram(info, ram, 1);
+	huge_align = 1;
+	base = add(info, SZ_1G, -1);
+	expect(base == SZ_1G, "1G at 0x%lx\n", base);
+	base = add(info, 4 << 20, -1);
+	expect(base == 0xbfa00000, "4M at 0x%lx\n", base);
+	base = add(info, 1 << 20, -1);
+	expect(base == 0xbfe00000, "1M at 0x%lx\n", base);
+}
+
+/*
+ * A range big enough for the buffer but without an aligned window in
+ * it must be skipped, not have the buffer put below its start.
+ */
+static void test_no_room(struct kexec_info *info)
+{
+	static const struct memory_range two[] = {
+		{ 0x200000, 0x5fffff, RANGE_RAM },
+		{ 0x700000, 0xafffff, RANGE_RAM },
+	};
+	static const struct memory_range one[] = {
+		{ 0x100000, 0x400fffff, RANGE_RAM },
+	};
+	unsigned long base;
+
+	huge_align = 1;
+	set_ram(info, two, 2);
+	base = add(info, 4 << 20, -1);
+	expect(base == 0x200000, "4M in the lower range at 0x%lx\n", base);
+
+	set_ram(info, two, 2);
+	base = add(info, 4 << 20, 1);
+	expect(base == 0x200000, "4M bottom up at 0x%lx\n", base);
+
+	/* Neither 1G nor 2M fits, so page alignment it is */
+	set_ram(info, one, 1);
+	base = add(info, SZ_1G, -1);
+	expect(base == 0x100000, "unalignable 1G at 0x%lx\n", base);
+}
+
+static void test_merge(struct kexec_info *info)
+{
+	static const struct memory_range ram[] = {
+		{ 0x100000, 0x3fffff, RANGE_RAM },
+	};
+	static char buf[3][4096];
+	int page = getpagesize();
+
+	set_ram(info, ram, 1);
+	add_segment(info, buf[0], page, 0x200000, page);
+	add_segment(info, buf[1], page, 0x200000 + page, page);
+	add_segment(info, buf[2], page, 0x300000, page);
+	/* Next in memory, but not in the buffers */
+	add_segment(info, buf[0], page, 0x300000 + page, page);
+	merge_segments(info);
+	expect(info->nr_segments == 3, "%d segments after merging\n",
+	       info->nr_segments);
+	expect(info->segment[0].bufsz == 2 * page &&
+	       info->segment[0].memsz == 2 * page,
+	       "first segment is 0x%zx bytes\n", info->segment[0].bufsz);
+}
+
+static void test_histogram(struct kexec_info *info)
+{
+	static const struct memory_range ram[] = {
+		{ 0x10000, 0x7fffffff, RANGE_RAM },
+	};
+	static const char want[] = "segment alignment: 1G 1 2M 2 64K 1 page 1\n";
+	char got[128] = "";
+	FILE *f;
+
+	set_ram(info, ram, 1);
+	add_segment(info, NULL, 0, SZ_1G, 4096);
+	add_segment(info, NULL, 0, SZ_2M, 4096);
+	add_segment(info, NULL, 0, 3 * SZ_2M, 4096);
+	add_segment(info, NULL, 0, 0x10000, 4096);
+	add_segment(info, NULL, 0, 0x201000, 4096);
+
+	f = tmpfile();
+	if (!f)
+		die("tmpfile failed: %s\n", strerror(errno));
+	print_segment_alignment(f, info);
+	rewind(f);
+	if (!fgets(got, sizeof(got), f))
+		got[0] = '\0';
+	fclose(f);
+	expect(strcmp(got, want) == 0, "histogram is \"%s\"\n", got);
+}
+
+int main(void)
+{
+	struct kexec_info info;
+
+	if (getpagesize() != 4096) {
+		printf("huge-align-test: needs 4K pages, skipped\n");
+		return 0;
+	}
+	memset(&info, 0, sizeof(info));
+	test_align(&info);
+	test_no_room(&info);
+	test_merge(&info);
+	test_histogram(&info);
+	free(info.segment);
+	if (!failed)
+		printf("huge-align-test: ok\n");
+	return failed;
+}
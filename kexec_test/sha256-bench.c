@@ -0,0 +1,93 @@
+/*
+ * sha256-bench.c: Time purgatory's sha256 against util_lib's
+ *
+ * Links three builds of util_lib/sha256.c: purgatory/sha256.o exactly
+ * as it went into purgatory.ro (symbols renamed purgatory_sha256_*),
+ * util_lib/sha256.o as kexec uses it, and an -O0 build (o0_sha256_*)
+ * like purgatory used before.  Each hashes the same buffer; the digests
+ * must match and the throughput of each is printed.
+ *
+ *	sha256-bench [megabytes]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sha256.h"
+
+#define DECLARE_SHA256(prefix)						\
+void prefix##sha256_starts(sha256_context *ctx);			\
+void prefix##sha256_update(sha256_context *ctx, const uint8_t *input,	\
+			   size_t length);				\
+void prefix##sha256_finish(sha256_context *ctx, sha256_digest_t digest);
+
+DECLARE_SHA256(purgatory_)
+DECLARE_SHA256(o0_)
+
+struct sha256_impl {
+	const char *name;
+	void (*starts)(sha256_context *ctx);
+	void (*update)(sha256_context *ctx, const uint8_t *input,
+		       size_t length);
+	void (*finish)(sha256_context *ctx, sha256_digest_t digest);
+};
+
+static const struct sha256_impl impls[] = {
+	{ "purgatory", purgatory_sha256_starts, purgatory_sha256_update,
+	  purgatory_sha256_finish },
+	{ "util_lib", sha256_starts, sha256_update, sha256_finish },
+	{ "-O0", o0_sha256_starts, o0_sha256_update, o0_sha256_finish },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+	size_t len = mb << 20, i;
+	sha256_digest_t digest, first;
+	sha256_context ctx;
+	uint32_t seed = 1;
+	uint8_t *buf;
+	double t0, t1;
+	unsigned n;
+
+	buf = malloc(len);
+	if (!mb || !buf) {
+		fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+		return 1;
+	}
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	for (n = 0; n < sizeof(impls) / sizeof(impls[0]); n++) {
+		t0 = now();
+		impls[n].starts(&ctx);
+		impls[n].update(&ctx, buf, len);
+		impls[n].finish(&ctx, digest);
+		t1 = now();
+		if (n == 0)
+			memcpy(first, digest, sizeof(first));
+		else if (memcmp(first, digest, sizeof(first))) {
+			fprintf(stderr, "%s: sha256 digest differs\n",
+				impls[n].name);
+			return 1;
+		}
+		printf("%-9s %zu MB in %.3f s, %.0f MB/s\n", impls[n].name,
+		       mb, t1 - t0, mb / (t1 - t0));
+	}
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * xen-load-test.c: Run xen_kexec_load() against the mock libxenctrl
+ *
+ * kexec-xen.c is built with HAVE_LIBXENCTRL against xenctrl-mock/, which
+ * refuses segments that are not in hypercall memory.  A segment inside
+ * a buffer from xen_seg_alloc() has to reach Xen as is, anything else
+ * has to be bounced, and the xen_seg_alloc() buffers have to outlive
+ * every load.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kexec.h"
+#include "kexec-syscall.h"
+#include "xenctrl.h"
+
+static int failed;
+
+#define expect(cond, ...) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);	\
+		fprintf(stderr, __VA_ARGS__);				\
+		failed = 1;						\
+	}								\
+} while (0)
+
+/* Did Xen get seg, and did it read the right bytes? */
+static void check_segment(int n, const struct kexec_segment *seg,
+			  int zero_copy)
+{
+	const xen_kexec_segment_t *xs = &mock_xc_load.segments[n];
+
+	expect(xs->buf_size == seg->bufsz, "segment %d is 0x%llx bytes\n", n,
+	       (unsigned long long)xs->buf_size);
+	expect(xs->dest_maddr == (uint64_t)(unsigned long)seg->mem &&
+	       xs->dest_size == seg->memsz, "segment %d destination\n", n);
+	expect(mock_xc_load.data[n] &&
+	       memcmp(mock_xc_load.data[n], seg->buf, seg->bufsz) == 0,
+	       "segment %d data differs\n", n);
+	if (zero_copy)
+		expect(xs->buf.h.p == seg->buf, "segment %d was copied\n", n);
+	else
+		expect(xs->buf.h.p != seg->buf, "segment %d was not bounced\n",
+		       n);
+}
+
+static void check_load(struct kexec_info *info, int type)
+{
+	const xen_kexec_segment_t *last;
+	int calls = mock_xc_load.calls;
+
+	expect(xen_kexec_load(info) == 0, "xen_kexec_load failed\n");
+	expect(mock_xc_load.calls == calls + 1, "xc_kexec_load not called\n");
+	expect(mock_xc_load.type == type, "type %d\n", mock_xc_load.type);
+	expect(mock_xc_load.entry == (uint64_t)(unsigned long)info->entry,
+	       "entry 0x%llx\n", (unsigned long long)mock_xc_load.entry);
+#if defined(__i386__) || defined(__x86_64__)
+	expect(mock_xc_load.arch == EM_386, "arch %d\n", mock_xc_load.arch);
+#endif
+	expect(mock_xc_load.nr_segments == (uint32_t)info->nr_segments + 1,
+	       "%u segments\n", mock_xc_load.nr_segments);
+	if (mock_xc_load.nr_segments != (uint32_t)info->nr_segments + 1)
+		return;
+	check_segment(0, &info->segment[0], 0);
+	check_segment(1, &info->segment[1], 1);
+	check_segment(2, &info->segment[2], 1);
+
+	/* Plus the low 1 MiB */
+	last = &mock_xc_load.segments[info->nr_segments];
+	expect(last->buf_size == 0 && last->buf.h.p == NULL &&
+	       last->dest_maddr == 0 && last->dest_size == 1 << 20,
+	       "no low 1 MiB segment\n");
+}
+
+int main(void)
+{
+	size_t initrd_size = 3 * 4096 + 100, kernel_size = 5000, i;
+	struct kexec_segment seg[3];
+	struct kexec_info info;
+	char *initrd, *kernel;
+
+	expect(xen_seg_alloc(0) == NULL, "allocated 0 bytes\n");
+	initrd = xen_seg_alloc(initrd_size);
+	kernel = malloc(kernel_size);
+	if (!initrd || !kernel) {
+		fprintf(stderr, "FAIL: no memory for the segments\n");
+		return 1;
+	}
+	expect(mock_xc_live_buffers == 1, "%d hypercall buffers\n",
+	       mock_xc_live_buffers);
+	for (i = 0; i < initrd_size; i++)
+		initrd[i] = i * 7;
+	for (i = 0; i < kernel_size; i++)
+		kernel[i] = i * 13;
+
+	memset(&info, 0, sizeof(info));
+	seg[0].buf = kernel;
+	seg[0].bufsz = kernel_size;
+	seg[0].mem = (void *)0x1000000;
+	seg[0].memsz = 0x2000;
+	seg[1].buf = initrd;
+	seg[1].bufsz = initrd_size;
+	seg[1].mem = (void *)0x2000000;
+	seg[1].memsz = 0x4000;
+	/* Part of an xen_seg_alloc() buffer is passed as is as well */
+	seg[2].buf = initrd + 4096;
+	seg[2].bufsz = 100;
+	seg[2].mem = (void *)0x3000000;
+	seg[2].memsz = 0x1000;
+	info.segment = seg;
+	info.nr_segments = 3;
+	info.entry = (void *)0x1000000;
+
+	check_load(&info, KEXEC_TYPE_DEFAULT);
+	/* The bounce buffers are gone, the initrd buffer is not */
+	expect(mock_xc_live_buffers == 1, "%d hypercall buffers after load\n",
+	       mock_xc_live_buffers);
+
+	/* And it is still good for another load */
+	info.kexec_flags = KEXEC_ON_CRASH;
+	check_load(&info, KEXEC_TYPE_CRASH);
+	expect(mock_xc_live_buffers == 1, "%d hypercall buffers after "
+	       "second load\n", mock_xc_live_buffers);
+
+	free(kernel);
+	if (!failed)
+		printf("xen-load-test: ok\n");
+	return failed;
+}
@@ -0,0 +1,238 @@
+/*
+ * xenctrl-mock.c: Enough of libxenctrl to run kexec-xen.c without Xen
+ *
+ * Hypercall buffers are page aligned heap memory, tracked while they
+ * are live.  xc_kexec_load() checks, as Xen's copy_from_guest() would,
+ * that every segment it is handed lies inside a live hypercall buffer,
+ * copies the segments out and records them in mock_xc_load.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "xenctrl.h"
+
+struct xc_interface_core {
+	int open;
+};
+
+struct xc_hypercall_buffer_array {
+	unsigned max_bufs;
+	xc_hypercall_buffer_t *hbufs;
+};
+
+xc_hypercall_buffer_t XC__HYPERCALL_BUFFER_NAME(HYPERCALL_BUFFER_NULL) = {
+	.hbuf = NULL,
+	.param_shadow = NULL,
+	HYPERCALL_BUFFER_INIT_NO_BOUNCE
+};
+
+struct mock_xc_load mock_xc_load;
+int mock_xc_live_buffers;
+
+/* The live hypercall buffers */
+#define MOCK_XC_MAX_BUFFERS	64
+static struct {
+	void *buf;
+	size_t size;
+} live[MOCK_XC_MAX_BUFFERS];
+
+static void *mock_alloc(xc_hypercall_buffer_t *b, size_t size)
+{
+	size_t page_size = getpagesize();
+	void *buf;
+	int i;
+
+	for (i = 0; i < MOCK_XC_MAX_BUFFERS; i++)
+		if (!live[i].buf)
+			break;
+	if (i == MOCK_XC_MAX_BUFFERS || !size)
+		return NULL;
+	size = (size + page_size - 1) & ~(page_size - 1);
+	if (posix_memalign(&buf, page_size, size))
+		return NULL;
+	live[i].buf = buf;
+	live[i].size = size;
+	mock_xc_live_buffers++;
+	b->hbuf = buf;
+	b->sz = size;
+	return buf;
+}
+
+static void mock_free(xc_hypercall_buffer_t *b)
+{
+	int i;
+
+	if (!b->hbuf)
+		return;
+	for (i = 0; i < MOCK_XC_MAX_BUFFERS; i++)
+		if (live[i].buf == b->hbuf)
+			break;
+	if (i == MOCK_XC_MAX_BUFFERS) {
+		fprintf(stderr, "mock: freeing unknown hypercall buffer %p\n",
+			b->hbuf);
+		abort();
+	}
+	free(live[i].buf);
+	live[i].buf = NULL;
+	mock_xc_live_buffers--;
+	b->hbuf = NULL;
+}
+
+/* Is p..p+size inside a live hypercall buffer? */
+static int mock_live(const void *p, size_t size)
+{
+	const char *start;
+	int i;
+
+	for (i = 0; i < MOCK_XC_MAX_BUFFERS; i++) {
+		start = live[i].buf;
+		if (start && (const char *)p >= start &&
+		    size <= live[i].size &&
+		    (size_t)((const char *)p - start) <= live[i].size - size)
+			return 1;
+	}
+	return 0;
+}
+
+xc_interface *xc_interface_open(xentoollog_logger *logger,
+				xentoollog_logger *dombuild_logger,
+				unsigned open_flags)
+{
+	xc_interface *xch = calloc(1, sizeof(*xch));
+
+	if (xch)
+		xch->open = 1;
+	return xch;
+}
+
+int xc_interface_close(xc_interface *xch)
+{
+	free(xch);
+	return 0;
+}
+
+void *xc__hypercall_buffer_alloc_pages(xc_interface *xch,
+				       xc_hypercall_buffer_t *b, int nr_pages)
+{
+	return mock_alloc(b, (size_t)nr_pages * getpagesize());
+}
+
+void xc__hypercall_buffer_free_pages(xc_interface *xch,
+				     xc_hypercall_buffer_t *b, int nr_pages)
+{
+	mock_free(b);
+}
+
+xc_hypercall_buffer_array_t *xc_hypercall_buffer_array_create(
+	xc_interface *xch, unsigned n)
+{
+	xc_hypercall_buffer_array_t *array = calloc(1, sizeof(*array));
+
+	if (!array)
+		return NULL;
+	array->max_bufs = n;
+	array->hbufs = calloc(n, sizeof(*array->hbufs));
+	if (!array->hbufs) {
+		free(array);
+		return NULL;
+	}
+	return array;
+}
+
+void *xc__hypercall_buffer_array_alloc(xc_interface *xch,
+				       xc_hypercall_buffer_array_t *array,
+				       unsigned index,
+				       xc_hypercall_buffer_t *hbuf,
+				       size_t size)
+{
+	void *buf;
+
+	/* libxenctrl aborts on these too */
+	if (index >= array->max_bufs || array->hbufs[index].hbuf)
+		abort();
+	buf = mock_alloc(hbuf, size);
+	if (buf)
+		array->hbufs[index] = *hbuf;
+	return buf;
+}
+
+void *xc__hypercall_buffer_array_get(xc_interface *xch,
+				     xc_hypercall_buffer_array_t *array,
+				     unsigned index,
+				     xc_hypercall_buffer_t *hbuf)
+{
+	if (index >= array->max_bufs || !array->hbufs[index].hbuf)
+		abort();
+	*hbuf = array->hbufs[index];
+	return array->hbufs[index].hbuf;
+}
+
+void xc_hypercall_buffer_array_destroy(xc_interface *xc,
+				       xc_hypercall_buffer_array_t *array)
+{
+	unsigned i;
+
+	if (!array)
+		return;
+	for (i = 0; i < array->max_bufs; i++)
+		mock_free(&array->hbufs[i]);
+	free(array->hbufs);
+	free(array);
+}
+
+int xc_kexec_exec(xc_interface *xch, int type)
+{
+	return 0;
+}
+
+int xc_kexec_load(xc_interface *xch, uint8_t type, uint16_t arch,
+		  uint64_t entry_maddr, uint32_t nr_segments,
+		  xen_kexec_segment_t *segments)
+{
+	struct mock_xc_load *load = &mock_xc_load;
+	int calls = load->calls;
+	uint32_t i;
+
+	for (i = 0; i < load->nr_segments; i++)
+		free(load->data[i]);
+	memset(load, 0, sizeof(*load));
+	load->calls = calls + 1;
+	if (nr_segments > MOCK_XC_MAX_SEGMENTS) {
+		errno = EINVAL;
+		return -1;
+	}
+	load->type = type;
+	load->arch = arch;
+	load->entry = entry_maddr;
+	for (i = 0; i < nr_segments; i++) {
+		load->nr_segments = i + 1;
+		load->segments[i] = segments[i];
+		if (!segments[i].buf_size)
+			continue;
+		if (!mock_live(segments[i].buf.h.p, segments[i].buf_size)) {
+			fprintf(stderr, "mock: segment %u at %p is not in "
+				"hypercall memory\n", i, segments[i].buf.h.p);
+			errno = EFAULT;
+			return -1;
+		}
+		load->data[i] = malloc(segments[i].buf_size);
+		if (!load->data[i]) {
+			errno = ENOMEM;
+			return -1;
+		}
+		memcpy(load->data[i], segments[i].buf.h.p,
+		       segments[i].buf_size);
+	}
+	return 0;
+}
+
+int xc_kexec_unload(xc_interface *xch, int type)
+{
+	return 0;
+}
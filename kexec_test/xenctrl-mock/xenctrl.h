@@ -0,0 +1,150 @@
+/*
+ * xenctrl.h: The part of libxenctrl that kexec uses, for testing
+ *
+ * The declarations and macros follow Xen's tools/libxc/include/xenctrl.h
+ * and public/kexec.h closely enough that code building against this
+ * builds against the real thing: hypercall buffers are declared and
+ * passed the same way, and guest handles can only be set from a
+ * hypercall buffer or with set_xen_guest_handle_raw().
+ *
+ * xenctrl-mock.c implements it on top of malloc() and records what
+ * xc_kexec_load() was given in mock_xc_load.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ */
+#ifndef XENCTRL_H
+#define XENCTRL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct xc_interface_core xc_interface;
+typedef struct xentoollog_logger xentoollog_logger;
+
+xc_interface *xc_interface_open(xentoollog_logger *logger,
+				xentoollog_logger *dombuild_logger,
+				unsigned open_flags);
+int xc_interface_close(xc_interface *xch);
+
+/* public/xen.h guest handles */
+#define __DEFINE_XEN_GUEST_HANDLE(name, type) \
+	typedef struct { type *p; } __guest_handle_ ## name
+#define XEN_GUEST_HANDLE(name)	__guest_handle_ ## name
+#define set_xen_guest_handle_raw(hnd, val) \
+	do { (hnd).p = (val); } while (0)
+
+__DEFINE_XEN_GUEST_HANDLE(const_void, const void);
+
+/* public/kexec.h */
+#define KEXEC_TYPE_DEFAULT	0
+#define KEXEC_TYPE_CRASH	1
+
+typedef struct xen_kexec_segment {
+	union {
+		XEN_GUEST_HANDLE(const_void) h;
+		uint64_t _pad;
+	} buf;
+	uint64_t buf_size;
+	uint64_t dest_maddr;
+	uint64_t dest_size;
+} xen_kexec_segment_t;
+
+/* Hypercall buffers */
+typedef struct xc_hypercall_buffer xc_hypercall_buffer_t;
+struct xc_hypercall_buffer {
+	void *hbuf;
+	xc_hypercall_buffer_t *param_shadow;
+	int dir;
+	void *ubuf;
+	size_t sz;
+};
+
+#define XC__HYPERCALL_BUFFER_NAME(_name) xc__hypercall_buffer_##_name
+
+#define HYPERCALL_BUFFER(_name)						\
+	({ xc_hypercall_buffer_t _hcbuf_buf1;				\
+	   typeof(XC__HYPERCALL_BUFFER_NAME(_name)) *_hcbuf_buf2 =	\
+		&XC__HYPERCALL_BUFFER_NAME(_name);			\
+	   (void)(&_hcbuf_buf1 == _hcbuf_buf2);				\
+	   (_hcbuf_buf2)->param_shadow ?				\
+		(_hcbuf_buf2)->param_shadow : (_hcbuf_buf2);		\
+	 })
+
+#define HYPERCALL_BUFFER_INIT_NO_BOUNCE .dir = 0, .sz = 0, .ubuf = (void *)-1
+
+#define DECLARE_HYPERCALL_BUFFER(_type, _name)				\
+	_type *(_name) = NULL;						\
+	xc_hypercall_buffer_t XC__HYPERCALL_BUFFER_NAME(_name) = {	\
+		.hbuf = NULL,						\
+		.param_shadow = NULL,					\
+		HYPERCALL_BUFFER_INIT_NO_BOUNCE				\
+	}
+
+/* Use with set_xen_guest_handle in place of NULL */
+extern xc_hypercall_buffer_t XC__HYPERCALL_BUFFER_NAME(HYPERCALL_BUFFER_NULL);
+
+#define set_xen_guest_handle_impl(_hnd, _val, _byte_off)		\
+	do {								\
+		xc_hypercall_buffer_t _hcbuf_hnd1;			\
+		typeof(XC__HYPERCALL_BUFFER_NAME(_val)) *_hcbuf_hnd2 =	\
+			HYPERCALL_BUFFER(_val);				\
+		(void)(&_hcbuf_hnd1 == _hcbuf_hnd2);			\
+		set_xen_guest_handle_raw(_hnd,				\
+			(char *)(_hcbuf_hnd2)->hbuf + (_byte_off));	\
+	} while (0)
+
+#define set_xen_guest_handle(_hnd, _val)				\
+	set_xen_guest_handle_impl(_hnd, _val, 0)
+
+void *xc__hypercall_buffer_alloc_pages(xc_interface *xch,
+				       xc_hypercall_buffer_t *b, int nr_pages);
+#define xc_hypercall_buffer_alloc_pages(_xch, _name, _nr)		\
+	xc__hypercall_buffer_alloc_pages(_xch, HYPERCALL_BUFFER(_name), _nr)
+void xc__hypercall_buffer_free_pages(xc_interface *xch,
+				     xc_hypercall_buffer_t *b, int nr_pages);
+#define xc_hypercall_buffer_free_pages(_xch, _name, _nr)		\
+	xc__hypercall_buffer_free_pages(_xch, HYPERCALL_BUFFER(_name), _nr)
+
+typedef struct xc_hypercall_buffer_array xc_hypercall_buffer_array_t;
+xc_hypercall_buffer_array_t *xc_hypercall_buffer_array_create(
+	xc_interface *xch, unsigned n);
+void *xc__hypercall_buffer_array_alloc(xc_interface *xch,
+				       xc_hypercall_buffer_array_t *array,
+				       unsigned index,
+				       xc_hypercall_buffer_t *hbuf,
+				       size_t size);
+#define xc_hypercall_buffer_array_alloc(_xch, _array, _index, _name, _size) \
+	xc__hypercall_buffer_array_alloc(_xch, _array, _index,		\
+					 HYPERCALL_BUFFER(_name), _size)
+void *xc__hypercall_buffer_array_get(xc_interface *xch,
+				     xc_hypercall_buffer_array_t *array,
+				     unsigned index,
+				     xc_hypercall_buffer_t *hbuf);
+void xc_hypercall_buffer_array_destroy(xc_interface *xc,
+				       xc_hypercall_buffer_array_t *array);
+
+int xc_kexec_exec(xc_interface *xch, int type);
+int xc_kexec_load(xc_interface *xch, uint8_t type, uint16_t arch,
+		  uint64_t entry_maddr, uint32_t nr_segments,
+		  xen_kexec_segment_t *segments);
+int xc_kexec_unload(xc_interface *xch, int type);
+
+/* Mock only: what the last xc_kexec_load() was given */
+#define MOCK_XC_MAX_SEGMENTS	32
+struct mock_xc_load {
+	int calls;
+	uint8_t type;
+	uint16_t arch;
+	uint64_t entry;
+	uint32_t nr_segments;
+	xen_kexec_segment_t segments[MOCK_XC_MAX_SEGMENTS];
+	/* segment data as Xen would have read it during the call */
+	void *data[MOCK_XC_MAX_SEGMENTS];
+};
+extern struct mock_xc_load mock_xc_load;
+/* Mock only: number of hypercall buffers not yet freed */
+extern int mock_xc_live_buffers;
+
+#endif /* XENCTRL_H */
@@ -6,5 +6,6 @@ void sprintf(char *buffer, const char *fmt, ...);
 void printf(const char *fmt, ...);
 void setup_arch(void);
 void post_verification_setup_arch(void);
+int verify_segments(void);
 
 #endif /* PURGATORY_H */
@@ -1,13 +1,40 @@
-
 #include <limits.h>
 #include <stdint.h>
 #include <purgatory.h>
 #include <sha256.h>
+#include <crc32c.h>
 #include <string.h>
 #include "../kexec/kexec-sha256.h"
 
 struct sha256_region sha256_regions[SHA256_REGIONS] = {};
 sha256_digest_t sha256_digest = { };
+uint32_t crc32c_digest = 0;
+uint32_t verify_policy = VERIFY_SHA256;
+uint32_t verify_stride = VERIFY_STRIDE_DEFAULT;
+
+/*
+ * With VERIFY_SAMPLED only the first VERIFY_CHUNK bytes of every
+ * verify_stride chunks of a region are hashed.  This must match
+ * update_purgatory() in kexec.
+ */
+static void sha256_update_region(sha256_context *ctx,
+				 struct sha256_region *ptr)
+{
+	uint8_t *buf = (uint8_t *)((uintptr_t)ptr->start);
+	uint64_t step, off, len;
+
+	if (verify_policy != VERIFY_SAMPLED) {
+		sha256_update(ctx, buf, ptr->len);
+		return;
+	}
+	step = (uint64_t)VERIFY_CHUNK * verify_stride;
+	for (off = 0; off < ptr->len; off += step) {
+		len = ptr->len - off;
+		if (len > VERIFY_CHUNK)
+			len = VERIFY_CHUNK;
+		sha256_update(ctx, buf + off, len);
+	}
+}
 
 int verify_sha256_digest(void)
 {
@@ -18,8 +45,7 @@ int verify_sha256_digest(void)
 	sha256_starts(&ctx);
 	end = &sha256_regions[sizeof(sha256_regions)/sizeof(sha256_regions[0])];
 	for(ptr = sha256_regions; ptr < end; ptr++) {
-		sha256_update(&ctx, (uint8_t *)((uintptr_t)ptr->start),
-			      ptr->len);
+		sha256_update_region(&ctx, ptr);
 	}
 	sha256_finish(&ctx, digest);
 	if (memcmp(digest, sha256_digest, sizeof(digest)) != 0) {
@@ -39,11 +65,42 @@ int verify_sha256_digest(void)
 	return 0;
 }
 
+int verify_crc32c_digest(void)
+{
+	struct sha256_region *ptr, *end;
+	uint32_t crc = 0;
+
+	end = &sha256_regions[sizeof(sha256_regions)/sizeof(sha256_regions[0])];
+	for(ptr = sha256_regions; ptr < end; ptr++) {
+		crc = crc32c(crc, (uint8_t *)((uintptr_t)ptr->start),
+			     ptr->len);
+	}
+	if (crc != crc32c_digest) {
+		printf("crc32c does not match :(\n");
+		printf("       crc32c: %x\n", crc);
+		printf("crc32c_digest: %x\n", crc32c_digest);
+		return 1;
+	}
+	return 0;
+}
+
+int verify_segments(void)
+{
+	switch (verify_policy) {
+	case VERIFY_NONE:
+		return 0;
+	case VERIFY_CRC32C:
+		return verify_crc32c_digest();
+	default:
+		return verify_sha256_digest();
+	}
+}
+
 void purgatory(void)
 {
 	printf("I'm in purgatory\n");
 	setup_arch();
-	if (verify_sha256_digest()) {
+	if (verify_segments()) {
 		for(;;) {
 			/* loop forever */
 		}
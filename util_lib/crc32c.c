@@ -0,0 +1,168 @@
+/*
+ * crc32c.c: CRC-32C (Castagnoli polynomial 0x1EDC6F41)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation (version 2 of the License).
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * This is built into both kexec and purgatory, so it must stay free of
+ * libc and of anything that touches FPU/SIMD registers.  The x86 crc32
+ * instruction only uses general purpose registers and is fine to use in
+ * purgatory once cpuid says it exists.
+ */
+
+#include <stdint.h>
+#include <crc32c.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define HAVE_CRC32C_HW
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HAVE_CRC32C_HW
+#endif
+
+#define CRC32C_POLY	0x82F63B78	/* 0x1EDC6F41 reflected */
+
+/*
+ * Slicing-by-8 tables: crc32c_table[0] is the usual byte-at-a-time
+ * table, crc32c_table[k][n] is the CRC of byte n followed by k zero
+ * bytes.  They are filled in on first use rather than carried as 8KB
+ * of constants.
+ */
+static uint32_t crc32c_table[8][256];
+static int crc32c_table_ready = 0;
+
+static void crc32c_init_table(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+		crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+	crc32c_table_ready = 1;
+}
+
+/* Little endian load that works at any alignment on any host */
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint32_t lo, hi;
+
+	if (!crc32c_table_ready)
+		crc32c_init_table();
+	while (len >= 8) {
+		lo = get_le32(buf) ^ crc;
+		hi = get_le32(buf + 4);
+		crc = crc32c_table[7][lo & 0xff] ^
+		      crc32c_table[6][(lo >> 8) & 0xff] ^
+		      crc32c_table[5][(lo >> 16) & 0xff] ^
+		      crc32c_table[4][lo >> 24] ^
+		      crc32c_table[3][hi & 0xff] ^
+		      crc32c_table[2][(hi >> 8) & 0xff] ^
+		      crc32c_table[1][(hi >> 16) & 0xff] ^
+		      crc32c_table[0][hi >> 24];
+		buf += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int crc32c_have_hw(void)
+{
+	static int have_hw = -1;
+	unsigned int eax, ebx, ecx, edx;
+
+	if (have_hw < 0)
+		have_hw = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+			  (ecx & bit_SSE4_2);
+	return have_hw;
+}
+
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+#ifdef __x86_64__
+	uint64_t crc64 = crc;
+
+	while (len >= 8) {
+		asm("crc32q %1, %0" : "+r" (crc64)
+				    : "rm" (*(const uint64_t *)buf));
+		buf += 8;
+		len -= 8;
+	}
+	crc = crc64;
+#endif
+	while (len >= 4) {
+		asm("crc32l %1, %0" : "+r" (crc)
+				    : "rm" (*(const uint32_t *)buf));
+		buf += 4;
+		len -= 4;
+	}
+	while (len--) {
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*buf));
+		buf++;
+	}
+	return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+/* Built for ARMv8 with the CRC extension, so no runtime check needed */
+static int crc32c_have_hw(void)
+{
+	return 1;
+}
+
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	while (len && ((uintptr_t)buf & 7)) {
+		crc = __crc32cb(crc, *buf++);
+		len--;
+	}
+	while (len >= 8) {
+		crc = __crc32cd(crc, *(const uint64_t *)buf);
+		buf += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = __crc32cb(crc, *buf++);
+	return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	crc = ~crc;
+#ifdef HAVE_CRC32C_HW
+	if (crc32c_have_hw())
+		return ~crc32c_hw(crc, buf, len);
+#endif
+	return ~crc32c_sw(crc, buf, len);
+}
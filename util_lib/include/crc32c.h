@@ -0,0 +1,13 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/*
+ * CRC-32C (Castagnoli), as used by iSCSI and ext4.  Start with crc = 0
+ * and feed the previous result back in to checksum data in pieces.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len);
+
+#endif /* CRC32C_H */